@@ -0,0 +1,66 @@
+#include <Arduino.h>
+#include <BSON.h>
+
+const char* keys[] = {"sensors", "temp", "hum", "time"};
+BSON::Dictionary dict(keys);
+
+BSON::StreamParser sp;
+size_t blocks = 0;
+
+void onBlock(BSON::StreamParser& p) {
+    if (p.getType() != BSType::Error) blocks++;
+}
+
+// распакованные блоки потока сразу уходят в потоковый парсер
+void onData(const uint8_t* data, size_t len) {
+    sp.feed(data, len);
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("start");
+
+    BSON b;
+    b.setDictionary(&dict);
+    b('{');
+    if (b["sensors"]('[')) {
+        for (int i = 0; i < 10; i++) {
+            b('{');
+            b["temp"] = 20 + i % 3;
+            b["hum"] = 40;
+            b["time"] = 1000 + i;
+            b('}');
+        }
+        b(']');
+    }
+    b('}');
+
+    // целиком, с тем же словарём при распаковке
+    BSON z, b2;
+    if (!BSON::compress(b, z, &dict) || !BSON::decompress(z, b2, &dict)) {
+        Serial.println("error");
+        return;
+    }
+    Serial.print("packet: ");
+    Serial.print(b.length());
+    Serial.print(", compressed: ");
+    Serial.println(z.length());
+    Serial.println(b2.length() == b.length() && !memcmp(b2.buf(), b.buf(), b.length()) ? "equal" : "differ");
+
+    // поток: сжатые данные приходят частями
+    sp.attach(onBlock);
+    BSON::Decompressor dec(onData);
+    dec.setDictionary(&dict);
+    for (size_t i = 0; i < z.length(); i += 16) {
+        size_t len = z.length() - i < 16 ? z.length() - i : 16;
+        if (!dec.feed(z.buf() + i, len)) break;
+    }
+    Serial.print("stream blocks: ");
+    Serial.println(blocks);
+    Serial.println(dec.isDone() && sp.isDone() ? "done" : "incomplete");
+
+    Serial.println("end");
+}
+
+void loop() {
+}
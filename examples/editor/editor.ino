@@ -0,0 +1,43 @@
+#include <Arduino.h>
+#include <BSON.h>
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("start");
+
+    BSON b;
+    b('{');
+    b["name"] = "node";
+    if (b["net"]('{')) {
+        b["port"] = 80;
+        if (b["ports"]('[')) {
+            b += 80;
+            b += 443;
+            b(']');
+        }
+        b('}');
+    }
+    b["tmp"] = true;
+    b('}');
+
+    b.stringify(Serial);
+
+    // изменения на месте, без пересборки пакета
+    BSON::Editor e(b);
+    e.set("net.port", 8080);        // другой размер: хвост пакета сдвигается
+    e.set("net.ports.1", "https");  // другой тип
+    e.add("net.mask", 24);          // новый ключ в конец объекта
+    e.remove("tmp");
+
+    Serial.print("has net.mask: ");
+    Serial.println(e.has("net.mask"));
+    Serial.print("set missing: ");
+    Serial.println(e.set("net.gw", 1));
+
+    b.stringify(Serial);
+
+    Serial.println("end");
+}
+
+void loop() {
+}
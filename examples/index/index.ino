@@ -0,0 +1,61 @@
+#include <Arduino.h>
+#include <BSON.h>
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("start");
+
+    BSON b;
+    b('{');
+    b["name"] = "node";
+    if (b["net"]('{')) {
+        b["ssid"] = "home";
+        if (b["ports"]('[')) {
+            b += 80;
+            b += 443;
+            b += 8080;
+            b(']');
+        }
+        b('}');
+    }
+    b["temp"].add(23.5, 1);
+    b('}');
+
+    // один проход по пакету, дальше доступ по пути без парсинга
+    BSON::Index idx(b);
+    if (!idx.valid()) {
+        Serial.println("error");
+        return;
+    }
+    Serial.print("entries: ");
+    Serial.println(idx.length());
+
+    BSON::Parser p = idx["net"]["ports"][2].parser();
+    if (p.next()) {
+        Serial.print("net.ports.2: ");
+        Serial.println(p.toInt());
+    }
+
+    p = idx["net"]["ssid"].parser();
+    if (p.next()) {
+        Serial.print("net.ssid: ");
+        Serial.write(p.toStr(), p.length());
+        Serial.println();
+    }
+
+    BSON::Index::Ref ports = idx["net"]["ports"];
+    Serial.print("ports: ");
+    Serial.print(ports.length());
+    Serial.print(" items, offset ");
+    Serial.print(ports.offset());
+    Serial.print(", size ");
+    Serial.println(ports.size());
+
+    Serial.print("missing: ");
+    Serial.println(idx["net"]["mask"].valid());
+
+    Serial.println("end");
+}
+
+void loop() {
+}
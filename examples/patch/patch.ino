@@ -0,0 +1,50 @@
+#include <Arduino.h>
+#include <BSON.h>
+
+void telemetry(BSON& b, int port, const char* ip, bool tmp) {
+    b('{');
+    b["id"] = 17;
+    if (b["net"]('{')) {
+        b["port"] = port;
+        b["ip.v4"] = ip;  // точка в ключе экранируется в пути патча
+        b('}');
+    }
+    if (tmp) b["tmp"] = 25;
+    b('}');
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("start");
+
+    // отправитель: предыдущий и новый пакеты
+    BSON prev, cur;
+    telemetry(prev, 80, "10.0.0.2", true);
+    telemetry(cur, 8080, "10.0.0.3", false);
+
+    BSON patch;
+    if (!BSON::diff(prev, cur, patch)) {
+        Serial.println("diff error");
+        return;
+    }
+    Serial.print("packet: ");
+    Serial.print(cur.length());
+    Serial.print(", patch: ");
+    Serial.println(patch.length());
+    patch.stringify(Serial);
+
+    // приёмник: применяет патч к своей копии предыдущего пакета
+    BSON base;
+    telemetry(base, 80, "10.0.0.2", true);
+    if (!BSON::applyPatch(base, patch)) {
+        Serial.println("apply error");
+        return;
+    }
+    base.stringify(Serial);
+    Serial.println(base.length() == cur.length() && !memcmp(base.buf(), cur.buf(), cur.length()) ? "equal" : "differ");
+
+    Serial.println("end");
+}
+
+void loop() {
+}
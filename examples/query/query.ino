@@ -0,0 +1,43 @@
+#include <Arduino.h>
+#include <BSON.h>
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("start");
+
+    BSON b;
+    b('{');
+    if (b["meta"]('{')) {
+        b["id"] = 42;
+        b["name"] = "order";
+        b('}');
+    }
+    if (b["items"]('[')) {
+        for (int i = 0; i < 3; i++) {
+            b('{');
+            b["sku"] = i;
+            b["qty"] = i * 10;
+            b('}');
+        }
+        b(']');
+    }
+    b('}');
+
+    // пути разбираются один раз, запрос можно применять к любому количеству пакетов
+    BSON::Query q("$.meta.id");
+    q.add("$.items[*].qty");
+
+    q.run(b, [](BSON::Parser& p, uint8_t path) {
+        Serial.print(path == 0 ? "id: " : "qty: ");
+        Serial.println(p.next() ? p.toInt() : -1);
+    });
+
+    // пакет только из выбранных значений с их путями
+    BSON out;
+    if (q.project(b, out)) out.stringify(Serial);
+
+    Serial.println("end");
+}
+
+void loop() {
+}
@@ -0,0 +1,70 @@
+#include <Arduino.h>
+#include <BSON.h>
+
+// вызывается на каждый блок, как только он получен целиком
+void onBlock(BSON::StreamParser& p) {
+    switch (p.getType()) {
+        case BSType::String:
+            // строка приходит кусками прямо из переданного буфера
+            if (p.isFirstChunk()) Serial.print("String: ");
+            Serial.write(p.chunk(), p.chunkLength());
+            if (p.isLastChunk()) Serial.println();
+            break;
+
+        case BSType::Integer:
+            Serial.print("Integer: ");
+            Serial.println(p.toInt());
+            break;
+
+        case BSType::Float:
+            Serial.print("Float: ");
+            Serial.println(p.toFloat());
+            break;
+
+        case BSType::Boolean:
+            Serial.print("Boolean: ");
+            Serial.println(p.toBool());
+            break;
+
+        case BSType::Container:
+            Serial.print(p.isObject() ? "Object" : "Array");
+            Serial.println(p.isOpen() ? "Open" : "Close");
+            break;
+
+        case BSType::Error:
+            Serial.println("Error");
+            break;
+
+        default:
+            break;
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("start");
+
+    BSON b;
+    b('{');
+    b["message"] = "streamed in small pieces";
+    b["id"] = 12345;
+    b["temp"].add(23.5, 1);
+    if (b["flags"]('[')) {
+        b += true;
+        b += false;
+        b(']');
+    }
+    b('}');
+
+    // пакет приходит частями, например из UART по 5 байт
+    BSON::StreamParser sp(onBlock);
+    for (size_t i = 0; i < b.length(); i += 5) {
+        size_t len = b.length() - i < 5 ? b.length() - i : 5;
+        if (!sp.feed(b.buf() + i, len)) break;
+    }
+
+    Serial.println(sp.isDone() ? "done" : "incomplete");
+}
+
+void loop() {
+}
@@ -0,0 +1,730 @@
+// Бенчмарк BSON на компьютере (Linux), без внешних зависимостей:
+//   g++ -std=c++11 -O2 -pthread -DBSON_USE_VECTOR -DBSON_NO_TEXT -I../../src bench.cpp -o bench
+//
+//   ./bench                       таблица
+//   ./bench --tsv > base.tsv      результаты для машин: name ns_op mb_s allocs_op
+//   ./bench --compare base.tsv    сравнить с base.tsv, код выхода 1 при замедлении больше порога
+//   --filter parse                только тесты, содержащие подстроку
+//   --time 200                    время одного замера, мс
+//   --threshold 10                порог замедления для --compare, %
+//   --threads 8                   наибольшее число потоков для pool/threads_N, по умолчанию - ядер
+
+#include <BSON.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ============== ALLOCS ==============
+static std::atomic<size_t> g_allocs{0};
+
+void* operator new(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// ============== RUNNER ==============
+struct Result {
+    std::string name;
+    double ns;      // нс на операцию
+    double mbs;     // МБ/с, 0 - без объёма
+    double allocs;  // выделений памяти на операцию
+};
+
+static std::vector<Result> g_results;
+static const char* g_filter = nullptr;
+static double g_time = 0.2;
+static unsigned g_threads = 0;
+static volatile size_t g_sink = 0;
+static std::atomic<size_t> g_tsink{0};  // для тестов в нескольких потоках
+
+typedef std::chrono::steady_clock Clock;
+
+// f(n) выполняет n операций, bytes - объём одной операции
+template <typename F>
+static void bench(const std::string& name, size_t bytes, F f) {
+    if (g_filter && name.find(g_filter) == std::string::npos) return;
+
+    f(1);  // прогрев
+    size_t n = 1;
+    while (true) {
+        Clock::time_point t = Clock::now();
+        f(n);
+        double s = std::chrono::duration<double>(Clock::now() - t).count();
+        if (s > g_time / 10 || n > (1ul << 30)) {
+            n = size_t(n * (g_time / (s > 1e-9 ? s : 1e-9))) + 1;
+            break;
+        }
+        n *= 4;
+    }
+
+    double best = 1e30;
+    size_t allocs = 0;
+    for (int r = 0; r < 5; r++) {
+        size_t a = g_allocs;
+        Clock::time_point t = Clock::now();
+        f(n);
+        double s = std::chrono::duration<double>(Clock::now() - t).count();
+        allocs = g_allocs - a;
+        best = std::min(best, s);
+    }
+
+    Result res;
+    res.name = name;
+    res.ns = best * 1e9 / n;
+    res.mbs = bytes ? bytes * n / best / 1e6 : 0;
+    res.allocs = double(allocs) / n;
+    g_results.push_back(res);
+}
+
+// ============== PAYLOADS ==============
+static const char* g_payloads[] = {"flat", "nested", "strings", "numbers", "binary"};
+
+static void build(BSON& b, int kind) {
+    static uint8_t blob[256];
+    static const char* keys[] = {"id", "temp", "hum", "press", "volt", "curr", "rssi", "uptime"};
+    b('{');
+    switch (kind) {
+        case 0:  // flat
+            for (int i = 0; i < 32; i++) {
+                b[keys[i & 7]] = i * 1000;
+            }
+            break;
+        case 1:  // nested
+            for (int i = 0; i < 16; i++) {
+                b["lvl"]('{');
+                b["n"] = i;
+            }
+            for (int i = 0; i < 16; i++) b('}');
+            break;
+        case 2:  // strings
+            for (int i = 0; i < 32; i++) {
+                b[keys[i & 7]] = "the quick brown fox jumps over the lazy";
+            }
+            break;
+        case 3:  // numbers
+            b["v"]('[');
+            for (int i = 0; i < 256; i++) {
+                if (i & 1) b.add(i * 0.37, 2);
+                else b += i * 12345;
+            }
+            b(']');
+            break;
+        case 4:  // binary
+            for (int i = 0; i < 8; i++) {
+                b[keys[i]].add(blob, sizeof(blob));
+            }
+            break;
+    }
+    b('}');
+}
+
+// линейный проход с чтением значений
+static size_t walk(BSON& b) {
+    BSON::Parser p(b);
+    size_t sum = 0;
+    while (p.next()) {
+        switch (p.getType()) {
+            case BSType::Integer: sum += p.toInt(); break;
+            case BSType::Float: sum += size_t(p.toFloat()); break;
+            case BSType::String: sum += p.length(); break;
+            case BSType::Binary: sum += p.length(); break;
+            case BSType::Boolean: sum += p.toBool(); break;
+            default: break;
+        }
+    }
+    return sum;
+}
+
+// пропуск всех значений верхнего уровня
+static size_t scan(BSON& b) {
+    BSON::Parser p(b);
+    size_t n = 0;
+    if (!p.next()) return 0;
+    while (p.next() && !p.isClose()) {
+        if (!p.next() || !p.skip()) break;
+        n++;
+    }
+    return n;
+}
+
+// ============== JSON DOM ==============
+// обычный путь в два шага для сравнения с fromJson: JSON разбирается в дерево, затем каждое значение через add()
+struct JNode {
+    enum Type : uint8_t { Null, Bool, Int, Float, Str, Arr, Obj } type = Null;
+    bool b = false;
+    int64_t i = 0;
+    double f = 0;
+    uint8_t dec = 0;
+    std::string s;                                    // строка или ключ в родительском объекте
+    std::vector<std::pair<std::string, JNode>> kids;  // элементы массива и пары объекта
+};
+
+static void domWs(const char*& p) {
+    while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') p++;
+}
+
+static bool domStr(const char*& p, std::string& out) {
+    out.clear();
+    for (++p; *p && *p != '"'; p++) {
+        if (*p != '\\') {
+            out += *p;
+            continue;
+        }
+        switch (*++p) {
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u': {
+                unsigned u = strtoul(std::string(p + 1, 4).c_str(), nullptr, 16);
+                if (u < 0x80) {
+                    out += char(u);
+                } else if (u < 0x800) {
+                    out += char(0xc0 | (u >> 6));
+                    out += char(0x80 | (u & 0x3f));
+                } else {
+                    out += char(0xe0 | (u >> 12));
+                    out += char(0x80 | ((u >> 6) & 0x3f));
+                    out += char(0x80 | (u & 0x3f));
+                }
+                p += 4;
+            } break;
+            case 0: return false;
+            default: out += *p; break;
+        }
+    }
+    if (*p != '"') return false;
+    p++;
+    return true;
+}
+
+static bool domParse(const char*& p, JNode& n) {
+    domWs(p);
+    if (*p == '{' || *p == '[') {
+        bool obj = *p++ == '{';
+        n.type = obj ? JNode::Obj : JNode::Arr;
+        domWs(p);
+        if (*p == (obj ? '}' : ']')) return ++p;
+        while (true) {
+            n.kids.emplace_back();
+            domWs(p);
+            if (obj) {
+                if (*p != '"' || !domStr(p, n.kids.back().first)) return false;
+                domWs(p);
+                if (*p++ != ':') return false;
+            }
+            if (!domParse(p, n.kids.back().second)) return false;
+            domWs(p);
+            if (*p == ',') {
+                p++;
+                continue;
+            }
+            return *p++ == (obj ? '}' : ']');
+        }
+    }
+    if (*p == '"') {
+        n.type = JNode::Str;
+        return domStr(p, n.s);
+    }
+    if (!strncmp(p, "true", 4) || !strncmp(p, "false", 5)) {
+        n.type = JNode::Bool;
+        n.b = *p == 't';
+        p += n.b ? 4 : 5;
+        return true;
+    }
+    if (!strncmp(p, "null", 4)) {
+        p += 4;
+        return true;
+    }
+    char* end;
+    n.i = strtoll(p, &end, 10);
+    if (*end == '.' || *end == 'e' || *end == 'E') {
+        n.type = JNode::Float;
+        n.f = strtod(p, &end);
+        const char* d = strchr(p, '.');
+        if (d && d < end) n.dec = std::min<ptrdiff_t>(end - d - 1, BS_DEC_MASK);
+    } else {
+        n.type = JNode::Int;
+    }
+    if (end == p) return false;
+    p = end;
+    return true;
+}
+
+static void domAdd(BSON& b, const JNode& n) {
+    switch (n.type) {
+        case JNode::Null: b.addNull(); break;
+        case JNode::Bool: b.add(n.b); break;
+        case JNode::Int: b.add(n.i); break;
+        case JNode::Float: b.add(n.f, n.dec); break;
+        case JNode::Str: b.add(n.s.data(), n.s.size()); break;
+        case JNode::Arr:
+        case JNode::Obj:
+            b(n.type == JNode::Obj ? '{' : '[');
+            for (const std::pair<std::string, JNode>& k : n.kids) {
+                if (n.type == JNode::Obj) b[k.first.c_str()];
+                domAdd(b, k.second);
+            }
+            b(n.type == JNode::Obj ? '}' : ']');
+            break;
+    }
+}
+
+// ============== BENCHMARKS ==============
+template <typename T>
+static void benchAdd(const char* name, T val) {
+    BSON b;
+    b.reserve(4096);
+    bench(std::string("add/") + name, 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (b.length() > 4000) b.clear();
+            b.add(val);
+        }
+        g_sink += b.length();
+    });
+}
+
+static void runAdd() {
+    static uint8_t blob[64];
+    static float arr[16];
+    BSON b;
+    b.reserve(4096);
+
+    benchAdd("int", int32_t(123456));
+    benchAdd("uint64", uint64_t(0x123456789abcdefull));
+    benchAdd("bool", true);
+    benchAdd("float", 3.14f);
+    benchAdd("str", "sensor");
+    bench("add/double_dec", 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (b.length() > 4000) b.clear();
+            b.add(i * 0.01, 2);
+        }
+        g_sink += b.length();
+    });
+    bench("add/bin64", 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (b.length() > 4000) b.clear();
+            b.add(blob, sizeof(blob));
+        }
+        g_sink += b.length();
+    });
+    bench("add/array16", 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (b.length() > 4000) b.clear();
+            b.addArray(arr);
+        }
+        g_sink += b.length();
+    });
+    bench("add/key_int", 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (b.length() > 4000) b.clear();
+            b["key"] = 42;
+        }
+        g_sink += b.length();
+    });
+}
+
+static void runPayloads() {
+    for (int k = 0; k < 5; k++) {
+        std::string pl = g_payloads[k];
+        BSON doc, sized;
+        build(doc, k);
+        sized.setSized(true);
+        build(sized, k);
+        size_t len = doc.length();
+
+        // сборка в новый пакет: выделения памяти на документ
+        bench("build/" + pl, len, [&](size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                BSON b;
+                build(b, k);
+                g_sink += b.length();
+            }
+        });
+
+        // сборка с переиспользованием буфера
+        BSON re;
+        bench("rebuild/" + pl, len, [&](size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                re.clear();
+                build(re, k);
+            }
+            g_sink += re.length();
+        });
+
+        bench("parse/" + pl, len, [&](size_t n) {
+            for (size_t i = 0; i < n; i++) g_sink += walk(doc);
+        });
+
+        bench("skip/" + pl, len, [&](size_t n) {
+            for (size_t i = 0; i < n; i++) g_sink += scan(doc);
+        });
+
+        bench("skip_sized/" + pl, sized.length(), [&](size_t n) {
+            for (size_t i = 0; i < n; i++) g_sink += scan(sized);
+        });
+
+        bench("validate/" + pl, len, [&](size_t n) {
+            for (size_t i = 0; i < n; i++) g_sink += BSON::validate(doc);
+        });
+
+        std::vector<char> json(doc.stringify(nullptr, 0) + 1);
+        doc.stringify(json.data(), json.size());  // для fromJson и при --filter без stringify
+        bench("stringify/" + pl, len, [&](size_t n) {
+            for (size_t i = 0; i < n; i++) g_sink += doc.stringify(json.data(), json.size());
+        });
+
+        BSON js;
+        bench("fromJson/" + pl, json.size() - 1, [&](size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                js.clear();
+                js.fromJson(json.data(), json.size() - 1);
+            }
+            g_sink += js.length();
+        });
+
+        bench("fromJson_dom/" + pl, json.size() - 1, [&](size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                const char* p = json.data();
+                JNode root;
+                js.clear();
+                if (domParse(p, root)) domAdd(js, root);
+            }
+            g_sink += js.length();
+        });
+    }
+}
+
+// f(count) в threads потоках, count поровну
+template <typename F>
+static void parallel(unsigned threads, size_t n, F f) {
+    std::vector<std::thread> th;
+    for (unsigned i = 0; i < threads; i++) th.emplace_back(f, n / threads + (i < n % threads));
+    for (std::thread& t : th) t.join();
+}
+
+// пул и обычный BSON: один поток, затем 1..N потоков, нс/op - время на пакет по всем потокам
+static void runPool() {
+    BSON::Pool pool;
+    bench("pool/get_put", 0, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            BSON b = pool.get();
+            build(b, 0);
+            g_sink += b.length();
+            pool.put(std::move(b));
+        }
+    });
+
+    unsigned cores = g_threads ? g_threads : std::thread::hardware_concurrency();
+    std::vector<unsigned> counts;
+    for (unsigned t = 1; t < cores; t *= 2) counts.push_back(t);
+    counts.push_back(cores ? cores : 1);
+
+    for (unsigned t : counts) {
+        bench("pool/threads_" + std::to_string(t), 0, [&](size_t n) {
+            parallel(t, n, [](size_t cnt) {
+                size_t sink = 0;
+                for (size_t i = 0; i < cnt; i++) {
+                    BSON b = BSON::Pool::get();
+                    build(b, 0);
+                    sink += b.length();
+                    BSON::Pool::put(std::move(b));
+                }
+                g_tsink.fetch_add(sink, std::memory_order_relaxed);
+            });
+        });
+        bench("pool/plain_threads_" + std::to_string(t), 0, [&](size_t n) {
+            parallel(t, n, [](size_t cnt) {
+                size_t sink = 0;
+                for (size_t i = 0; i < cnt; i++) {
+                    BSON b;
+                    build(b, 0);
+                    sink += b.length();
+                }
+                g_tsink.fetch_add(sink, std::memory_order_relaxed);
+            });
+        });
+    }
+}
+
+static void runQuery() {
+    BSON flat, nested;
+    nested.setSized(true);
+    build(flat, 0);
+    build(nested, 1);
+
+    BSON::Query q("$.uptime");
+    bench("query/run_flat", flat.length(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) q.run(flat, [](BSON::Parser& p, uint8_t) { g_sink += p.next(); });
+    });
+
+    BSON::Query d("$.lvl.lvl.lvl.n");
+    d.add("$.n");
+    BSON out;
+    bench("query/project_nested", nested.length(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            out.clear();
+            d.project(nested, out);
+        }
+        g_sink += out.length();
+    });
+}
+
+// поиск ключа: перебор и двоичный поиск в отсортированном объекте
+static void buildKeys(BSON& b) {
+    char key[8];
+    b('{');
+    for (int i = 255; i >= 0; i--) {
+        snprintf(key, sizeof(key), "k%03d", i);
+        b[key] = i;
+    }
+    b('}');
+}
+
+static void runFind() {
+    BSON plain, sorted;
+    sorted.setSorted(true);
+    buildKeys(plain);
+    buildKeys(sorted);
+
+    bench("find/build_sorted", sorted.length(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            sorted.clear();
+            buildKeys(sorted);
+        }
+    });
+    bench("find/linear", plain.length(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            BSON::Parser p(plain);
+            g_sink += p.next() && p.find("k010");
+        }
+    });
+    bench("find/sorted", sorted.length(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            BSON::Parser p(sorted);
+            g_sink += p.next() && p.find("k010");
+        }
+    });
+}
+
+// сжатие и распаковка: пакеты по отдельности и подряд, степень сжатия выводится после таблицы
+static std::vector<std::pair<std::string, double>> g_ratios;
+
+static void benchLz(const std::string& name, BSON& src, const BSDictionary* dict) {
+    BSON::Compressor c;
+    BSON::Decompressor d;
+    c.setDictionary(dict);
+    d.setDictionary(dict);
+    BSON z, r;
+    c.compress(src, z);
+
+    bench("lz/compress_" + name, src.length(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            z.clear();
+            c.compress(src, z);
+        }
+    });
+    bench("lz/decompress_" + name, src.length(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            r.clear();
+            d.decompress(z, r);
+        }
+        g_sink += r.length();
+    });
+    if (!g_filter || ("lz/" + name).find(g_filter) != std::string::npos) {
+        g_ratios.push_back(std::make_pair(name, double(src.length()) / z.length()));
+    }
+}
+
+static void runCompress() {
+    static const char* status[] = {"ok", "ok", "ok", "warning: low battery", "error: sensor timeout"};
+    BSON records;
+    BSDictionary dict;
+    uint32_t rnd = 1;
+    for (int i = 0; i < 4000; i++) {  // телеметрия с меняющимися значениями
+        rnd = rnd * 1103515245 + 12345;
+        BSON b;
+        b('{');
+        b["id"] = i;
+        b["device"] = "sensor-12";
+        b["temp"].add(20 + (rnd >> 16) % 100 * 0.1, 1);
+        b["hum"] = (rnd >> 8) % 100;
+        b["uptime"] = 1000000 + i * 5;
+        b["status"] = status[(rnd >> 4) % 5];
+        b('}');
+        dict.learn(b.buf(), b.length());
+        records += b;
+    }
+    dict.finish(64);
+
+    BSON flat, strings, numbers;
+    build(flat, 0);
+    build(strings, 2);
+    build(numbers, 3);
+    benchLz("flat", flat, nullptr);
+    benchLz("flat_dict", flat, &dict);
+    benchLz("strings", strings, nullptr);
+    benchLz("numbers", numbers, nullptr);
+    benchLz("records", records, nullptr);
+}
+
+// пакеты подряд: один поток и все ядра, без размера - с последовательным предварительным проходом
+static void runScanner() {
+    std::vector<uint8_t> data, plain;
+    for (int i = 0; i < 20000; i++) {
+        BSON b;
+        b.setSized(true);
+        build(b, i % 5);
+        data.insert(data.end(), b.buf(), b.buf() + b.length());
+        BSON u;
+        build(u, i % 5);
+        plain.insert(plain.end(), u.buf(), u.buf() + u.length());
+    }
+
+    BSON::Scanner one(1), all;
+    bench("scan/records_1", data.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) one.records(data.data(), data.size(), [](BSON::Parser& p, size_t) { g_tsink.fetch_add(p.next(), std::memory_order_relaxed); });
+    });
+    bench("scan/records_all", data.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) all.records(data.data(), data.size(), [](BSON::Parser& p, size_t) { g_tsink.fetch_add(p.next(), std::memory_order_relaxed); });
+    });
+    bench("scan/unsized_all", plain.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) all.records(plain.data(), plain.size(), [](BSON::Parser& p, size_t) { g_tsink.fetch_add(p.next(), std::memory_order_relaxed); });
+    });
+}
+
+#ifdef BS_LOG
+static void runLog() {
+    const char* path = "/tmp/bson_bench.log";
+    BSON doc;
+    build(doc, 0);
+
+    BSON::LogWriter w;
+    w.open("/dev/null");
+    bench("log/append", doc.length(), [&](size_t n) {
+        for (size_t i = 0; i < n; i++) w.append(doc);
+    });
+
+    unlink(path);
+    w.open(path);
+    for (int i = 0; i < 10000; i++) w.append(doc);
+    w.close();
+
+    BSON::LogReader r;
+    r.open(path);
+    size_t total = 0;
+    while (r.next()) total += r.length();
+    bench("log/scan", total, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            r.rewind();
+            while (r.next()) g_sink += r.length();
+        }
+    });
+    r.close();
+    unlink(path);
+}
+#endif
+
+// ============== OUTPUT ==============
+static void printTable() {
+    printf("%-24s %12s %10s %10s\n", "name", "ns/op", "MB/s", "allocs/op");
+    for (const Result& r : g_results) {
+        printf("%-24s %12.1f ", r.name.c_str(), r.ns);
+        if (r.mbs) printf("%10.1f ", r.mbs);
+        else printf("%10s ", "-");
+        printf("%10.2f\n", r.allocs);
+    }
+    for (size_t i = 0; i < g_ratios.size(); i++) {
+        if (!i) printf("\n%-24s %12s\n", "lz ratio", "x");
+        printf("%-24s %12.2f\n", g_ratios[i].first.c_str(), g_ratios[i].second);
+    }
+}
+
+static void printTsv() {
+    printf("name\tns_op\tmb_s\tallocs_op\n");
+    for (const Result& r : g_results) {
+        printf("%s\t%.2f\t%.2f\t%.2f\n", r.name.c_str(), r.ns, r.mbs, r.allocs);
+    }
+}
+
+// вернёт количество замедлений
+static int compare(const char* path, double threshold) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "can't open %s\n", path);
+        return -1;
+    }
+
+    int slower = 0;
+    char line[256];
+    printf("%-24s %12s %12s %8s\n", "name", "base ns/op", "ns/op", "diff");
+    while (fgets(line, sizeof(line), f)) {
+        char name[128];
+        double ns, mbs, allocs;
+        if (sscanf(line, "%127s %lf %lf %lf", name, &ns, &mbs, &allocs) != 4) continue;
+
+        for (const Result& r : g_results) {
+            if (r.name != name) continue;
+            double d = (r.ns - ns) / ns * 100;
+            bool bad = d > threshold || r.allocs > allocs;
+            if (bad) slower++;
+            printf("%-24s %12.1f %12.1f %+7.1f%%%s\n", name, ns, r.ns, d, bad ? "  <<" : "");
+        }
+    }
+    fclose(f);
+    return slower;
+}
+
+int main(int argc, char** argv) {
+    bool tsv = false;
+    const char* base = nullptr;
+    double threshold = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tsv")) tsv = true;
+        else if (!strcmp(argv[i], "--compare") && i + 1 < argc) base = argv[++i];
+        else if (!strcmp(argv[i], "--filter") && i + 1 < argc) g_filter = argv[++i];
+        else if (!strcmp(argv[i], "--time") && i + 1 < argc) g_time = atof(argv[++i]) / 1000;
+        else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) threshold = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) g_threads = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--tsv] [--compare base.tsv] [--filter str] [--time ms] [--threshold %%] [--threads n]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    runAdd();
+    runPayloads();
+    runPool();
+    runQuery();
+    runFind();
+    runCompress();
+    runScanner();
+#ifdef BS_LOG
+    runLog();
+#endif
+
+    if (base) {
+        int slower = compare(base, threshold);
+        if (slower < 0) return 2;
+        printf("%d slower than %.0f%%\n", slower, threshold);
+        return slower ? 1 : 0;
+    }
+    if (tsv) printTsv();
+    else printTable();
+    return 0;
+}
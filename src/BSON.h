@@ -1,6 +1,7 @@
 #pragma once
 #include <inttypes.h>
 #include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "BS_MACRO.h"
@@ -8,71 +9,68 @@
 #ifdef BSON_USE_VECTOR
 #include <vector>
 #define BS_STACK std::vector<uint8_t>
+
+// стек с интерфейсом gtl::stack для служебных таблиц
+template <typename T>
+class BSStack : public std::vector<T> {
+    typedef std::vector<T> V;
+
+   public:
+    bool push(const T& val) {
+        V::push_back(val);
+        return true;
+    }
+    T pop() {
+        T t = V::back();
+        V::pop_back();
+        return t;
+    }
+    T& last() { return V::back(); }
+    bool concat(const T* data, size_t len) {
+        V::insert(V::end(), data, data + len);
+        return true;
+    }
+    T* buf() { return V::data(); }
+    size_t length() const { return V::size(); }
+    bool reserve(size_t size) {
+        V::reserve(size);
+        return true;
+    }
+};
 #else
 #include <GTL.h>
 #define BS_STACK gtl::stack<uint8_t>
+
+template <typename T>
+using BSStack = gtl::stack<T>;
 #endif
 
 #if defined(ARDUINO) && !defined(BSON_NO_TEXT)
 #include <StringUtilsGyver.h>
 #endif
 
-// ============== BSON ==============
-class BSON : private BS_STACK {
-    typedef BS_STACK ST;
+#include "BS_Dictionary.h"
+#include "BS_Float.h"
+#include "BS_Stats.h"
 
+// наибольшая вложенность контейнеров для validate, стек на этой глубине не выделяет память
+#ifndef BS_VALIDATE_DEPTH
+#ifdef __AVR__
+#define BS_VALIDATE_DEPTH 16
+#else
+#define BS_VALIDATE_DEPTH 64
+#endif
+#endif
+
+// ============== BUILDER ==============
+// API сборки пакета. BS - наследник, реализует push(uint8_t) и write(data, len, pgm)
+template <typename BS>
+class BSBuilder {
 #define BSON_MAKE_ADD(T)                \
     void operator=(T val) { add(val); } \
     void operator+=(T val) { add(val); }
 
    public:
-#ifdef BSON_USE_VECTOR
-    using ST::clear;
-    using ST::reserve;
-    void push(uint8_t v) { ST::push_back(v); }
-    uint8_t* buf() { return ST::data(); }
-    uint16_t length() { return ST::size(); }
-    bool concat(const ST& st) {
-        ST::reserve(ST::size() + st.size());
-        ST::insert(ST::end(), st.begin(), st.end());
-        return true;
-    }
-    size_t write(const void* data, size_t len) {
-        const uint8_t* p = (const uint8_t*)data;
-        ST::reserve(ST::size() + len);
-        ST::insert(ST::end(), p, p + len);
-        return len;
-    }
-    size_t write(const void* data, size_t len, bool) {
-        return write(data, len);
-    }
-    size_t write(const uint8_t* data, size_t len) {
-        return write(data, len);
-    }
-    operator uint8_t*() {
-        return ST::data();
-    }
-    void setOversize(uint8_t) {}
-#else
-    using ST::buf;
-    using ST::clear;
-    using ST::concat;
-    using ST::length;
-    using ST::move;
-    using ST::reserve;
-    using ST::setOversize;
-    using ST::write;
-    using ST::operator uint8_t*;
-#endif
-
-    class Parser;
-
-    // ================ static ================
-    // максимальная длина строк и бинарных данных
-    static size_t maxDataLength() {
-        return BS_MAX_LEN;
-    }
-
     // размер числа в байтах
     static uint8_t uintSize(const uint8_t* p, uint8_t size) {
         switch (size) {
@@ -99,35 +97,63 @@ class BSON : private BS_STACK {
         return 0;
     }
 
-    // ============== add bson ==============
-    BSON& add(const BSON& bson) {
-        concat(bson);
-        return *this;
-    }
-    void operator+=(const BSON& bson) { add(bson); }
-
     // ============== container ==============
     // [ ] { }, всегда вернёт true
     bool operator()(char type) {
         switch (type) {
-            case '[': push(BS_ARR_OPEN); break;
-            case ']': push(BS_ARR_CLOSE); break;
-            case '{': push(BS_OBJ_OPEN); break;
-            case '}': push(BS_OBJ_CLOSE); break;
+            case '[': _self()._open(BS_ARR_OPEN); break;
+            case ']': _self()._close(BS_ARR_CLOSE); break;
+            case '{': _self()._open(BS_OBJ_OPEN); break;
+            case '}': _self()._close(BS_OBJ_CLOSE); break;
         }
         return true;
     }
 
     // ================ key =================
     template <typename T>
-    BSON& operator[](T key) { return add(key); }
+    BS& operator[](T key) {
+        _self()._keyed();
+        return add(key);
+    }
+
+    BS& operator[](char* key) { return _key(key, strlen(key)); }
+    BS& operator[](const char* key) { return _key(key, strlen(key)); }
+#ifdef ARDUINO
+    BS& operator[](const String& key) { return _key(key.c_str(), key.length()); }
+#ifndef BSON_NO_TEXT
+    BS& operator[](const Text& key) { return _key(key.str(), key.length(), key.pgm()); }
+#endif
+#endif
+
+    // словарь: ключи-строки из словаря заменяются на коды. nullptr - отключить
+    void setDictionary(const BSDictionary* dict) {
+        _dict = dict;
+    }
+
+    // ============== json ==============
+    // добавить JSON. Вернёт false при ошибке, пакет останется недописанным
+    bool fromJson(const char* json, size_t len);
+
+    // добавить JSON. Вернёт false при ошибке, пакет останется недописанным
+    bool fromJson(const char* json) {
+        return fromJson(json, strlen(json));
+    }
+
+    // ============== struct ==============
+    // добавить структуру с BSON_FIELDS как объект
+    template <typename T>
+    BS& encode(const T& t) {
+        _self()._open(BS_OBJ_OPEN);
+        _Enc e{*this};
+        t.bsonFields(e);
+        _self()._close(BS_OBJ_CLOSE);
+        return _self();
+    }
 
     // ============== val code ==============
     template <typename T>
-    BSON& add(T code) {
-        push(BS_CODE | BS_D16_MSB(code));
-        push(BS_D16_LSB(code));
-        return *this;
+    BS& add(T code) {
+        return _code(uint16_t(code));
     }
 
     template <typename T>
@@ -136,20 +162,20 @@ class BSON : private BS_STACK {
     void operator+=(T val) { add(val); }
 
     // ============== val bool ==============
-    BSON& add(bool b) {
-        push(BS_BOOLEAN | b);
-        return *this;
+    BS& add(bool b) {
+        _self().push(BS_BOOLEAN | b);
+        return _self();
     }
 
     BSON_MAKE_ADD(bool)
 
 // ============== val int ==============
 #define BSON_MAKE_UINT(T)                              \
-    BSON& add(T val) { return _int(&val, sizeof(T)); } \
+    BS& add(T val) { return _int(&val, sizeof(T)); } \
     BSON_MAKE_ADD(T)
 
 #define BSON_MAKE_INT(T)                                                                                     \
-    BSON& add(T val) { return val < 0 ? (val = -val, _int(&val, sizeof(T), true)) : _int(&val, sizeof(T)); } \
+    BS& add(T val) { return val < 0 ? (val = -val, _int(&val, sizeof(T), true)) : _int(&val, sizeof(T)); } \
     BSON_MAKE_ADD(T)
 
     BSON_MAKE_UINT(unsigned char)
@@ -171,205 +197,851 @@ class BSON : private BS_STACK {
     BSON_MAKE_INT(long long)
 
     // ============== val float ==============
-    BSON& add(float value, int dec) {
-        push(BS_FLOAT | BS_DECIMAL(dec));
-        write(&value, BS_FLOAT_SIZE);
-        return *this;
+    // dec - знаков после точки. Выбирается самая короткая форма, точная до dec знаков.
+    // Присваивание без dec (b = 3.14) пишет обычный float, dec = 4 только для вывода
+    BS& add(double value, int dec) {
+        if (dec < 0) dec = 0;
+        if (dec > BS_DEC_MASK) dec = BS_DEC_MASK;
+        float f = value;
+
+#ifndef BSON_NO_COMPACT_FLOAT
+        double m = BSFloat::pow10(dec);
+        double a = (value < 0 ? -value : value) * m + 0.5;
+        if (a < 1.8e19) {
+            uint64_t fix = a;
+            uint8_t size = uintSize((const uint8_t*)&fix, sizeof(fix));
+            auto exact = [&](double v) { return uint64_t((v < 0 ? -v : v) * m + 0.5) == fix; };
+
+            if (size > 2) {
+                uint16_t h = BSFloat::toHalf(f);
+                if (exact(BSFloat::fromHalf(h))) {
+                    _self().push(BS_FLOAT | BS_FLOAT_EXT | dec);
+                    _self().push(BS_FLOAT_HALF | 2);
+                    _self().write(&h, 2);
+                    return _self();
+                }
+            }
+            if (size <= 3 || !exact(f)) {
+                _self().push(BS_FLOAT | BS_FLOAT_EXT | dec);
+                _self().push(BS_FLOAT_FIX | (value < 0 ? BS_FLOAT_NEG : 0) | size);
+                _self().write(&fix, size);
+                return _self();
+            }
+        } else if (value == value && double(f) != value && sizeof(double) == 8) {
+            _self().push(BS_FLOAT | BS_FLOAT_EXT | dec);
+            _self().push(BS_FLOAT_DBL | 8);
+            _self().write(&value, 8);
+            return _self();
+        }
+#endif
+        _self().push(BS_FLOAT | dec);
+        _self().write(&f, BS_FLOAT_SIZE);
+        return _self();
     }
-    BSON& add(double value, int dec) { return add((float)value, dec); }
+    BS& add(float value, int dec) { return add(double(value), dec); }
 
-    void operator+=(float val) { add(val, 4); }
-    void operator=(float val) { add(val, 4); }
-    void operator+=(double val) { add(val, 4); }
-    void operator=(double val) { add(val, 4); }
+    void operator+=(float val) { _float(val, 4); }
+    void operator=(float val) { _float(val, 4); }
+    void operator+=(double val) { _float(val, 4); }
+    void operator=(double val) { _float(val, 4); }
 
     // ============== null ==============
-    BSON& addNull() {
-        push(BS_NULL);
-        return *this;
+    BS& addNull() {
+        _self().push(BS_NULL);
+        return _self();
+    }
+
+    // ============== typed array ==============
+    // массив чисел одним блоком: целые 1..8 байт, float, double
+    template <typename T>
+    BS& addArray(const T* arr, size_t len) {
+        static_assert(BS_TA_VALID(T), "addArray: integers of 1, 2, 4, 8 bytes, float or double");
+        uint8_t cnt = len > 0xffff ? 2 : (len > 0xff ? 1 : 0);
+        uint32_t n = len;
+        _self().push(BS_TYPED_ARR);
+        _self().push(BS_TA_TYPE(T) | (cnt << 6));
+        _self().write(&n, 1 << cnt);
+        _self().write(arr, len * sizeof(T));
+        return _self();
+    }
+
+    template <typename T, size_t N>
+    BS& addArray(const T (&arr)[N]) {
+        return addArray(arr, N);
     }
 
     // ============== val bin ==============
-    // затем вручную write(data, size, pgm)
-    bool beginBin(uint16_t size) {
-        if (size > BS_MAX_LEN) {
+    // затем вручную _self().write(data, size, pgm)
+    bool beginBin(size_t size) {
+        if (uint64_t(size) > BS_MAX_EXT_LEN) {
             addNull();
             return false;
         }
-        push(BS_BINARY | BS_D16_MSB(size));
-        push(BS_D16_LSB(size));
+        _lenHead(BS_BINARY, size);
         return true;
     }
     template <typename T>
-    BSON& addBin(const T& data) {
+    BS& addBin(const T& data) {
         return addBin(&data, sizeof(T));
     }
-    BSON& addBin(const void* data, size_t size, bool pgm = false) {
-        if (beginBin(size)) write(data, size, pgm);
-        return *this;
+    BS& addBin(const void* data, size_t size, bool pgm = false) {
+        if (beginBin(size)) _self().write(data, size, pgm);
+        return _self();
     }
-    BSON& add(const void* data, size_t size, bool pgm = false) {
+    BS& add(const void* data, size_t size, bool pgm = false) {
         return addBin(data, size, pgm);
     }
 
     // ============== val string ==============
-    // затем вручную write(str, len, pgm)
-    BSON& beginStr(size_t len) {
-        push(BS_STRING | BS_D16_MSB(len));
-        push(BS_D16_LSB(len));
-        return *this;
+    // затем вручную _self().write(str, len, pgm)
+    BS& beginStr(size_t len) {
+        _lenHead(BS_STRING, len);
+        return _self();
     }
-    BSON& addStr(const char* str, size_t len, bool pgm = false) {
-        if (len > BS_MAX_LEN) len = BS_MAX_LEN;
+    BS& addStr(const char* str, size_t len, bool pgm = false) {
+        if (uint64_t(len) > BS_MAX_EXT_LEN) len = BS_MAX_EXT_LEN;
         beginStr(len);
-        write(str, len, pgm);
-        return *this;
+        _self().write(str, len, pgm);
+        return _self();
     }
-    BSON& add(const char* str, size_t len, bool pgm = false) {
+    BS& add(const char* str, size_t len, bool pgm = false) {
         return addStr(str, len, pgm);
     }
 
-    BSON& add(char* str) { return add((const char*)str); }
-    BSON& add(const char* str) { return add(str, strlen(str), false); }
+    BS& add(char* str) { return add((const char*)str); }
+    BS& add(const char* str) { return add(str, strlen(str), false); }
 
     BSON_MAKE_ADD(char*)
     BSON_MAKE_ADD(const char*)
 
 #ifdef ARDUINO
-    BSON& add(const String& str) { return add(str.c_str(), str.length(), false); }
-    BSON& add(const __FlashStringHelper* str) { return add((const char*)str, strlen_P((PGM_P)str), true); }
+    BS& add(const String& str) { return add(str.c_str(), str.length(), false); }
+    BS& add(const __FlashStringHelper* str) { return add((const char*)str, strlen_P((PGM_P)str), true); }
 
     BSON_MAKE_ADD(const String&)
     BSON_MAKE_ADD(const __FlashStringHelper*)
 
-    BSON& add(const StringSumHelper&) = delete;
+    BS& add(const StringSumHelper&) = delete;
     void operator=(const StringSumHelper&) = delete;
     void operator+=(const StringSumHelper&) = delete;
 
 #ifndef BSON_NO_TEXT
-    BSON& add(const Text& str) { return add(str.str(), str.length(), str.pgm()); }
-    BSON& add(const Value& str) { return add((Text)str); }
+    BS& add(const Text& str) { return add(str.str(), str.length(), str.pgm()); }
+    BS& add(const Value& str) { return add((Text)str); }
 
     BSON_MAKE_ADD(const Text&)
     BSON_MAKE_ADD(const Value&)
 #endif
 #endif
 
-// ============== stringify ==============
-#if defined(ARDUINO) && !defined(BSON_USE_VECTOR)
-    // вывести в Print как JSON
-    void stringify(Print& p, bool pretty = false) {
-        stringify(*this, p, pretty);
+   protected:
+    const BSDictionary* _dict = nullptr;
+
+    struct _Enc {
+        BSBuilder& b;
+
+        template <typename V>
+        void operator()(uint8_t, const char* key, uint8_t len, const V& v) {
+            b._key(key, len);
+            b._encVal(v, 0);
+        }
+    };
+
+    template <typename V>
+    auto _encVal(const V& v, int) -> decltype(v.bsonFields(*(_Enc*)nullptr), void()) {
+        encode(v);
+    }
+    template <typename V, size_t N>
+    void _encVal(const V (&arr)[N], int) {
+        _self()._open(BS_ARR_OPEN);
+        for (size_t i = 0; i < N; i++) _encVal(arr[i], 0);
+        _self()._close(BS_ARR_CLOSE);
+    }
+    template <size_t N>
+    void _encVal(const char (&str)[N], int) {
+        add(str, strnlen(str, N));
+    }
+    void _encVal(float v, long) {
+        _float(v, 4);
+    }
+    void _encVal(double v, long) {
+        _float(v, 4);
+    }
+    template <typename V>
+    void _encVal(const V& v, long) {
+        add(v);
     }
 
-    // вывести в Print как JSON
-    static void stringify(BSON& bson, Print& p, bool pretty = false) {
-        stringify(bson, bson.length(), p, pretty);
+    BS& _self() {
+        return *static_cast<BS*>(this);
     }
 
-    // вывести в Print как JSON
-    static void stringify(const uint8_t* bson, size_t len, Print& p, bool pretty = false) {
-        const uint8_t* end = bson + len;
-        gtl::stack<uint8_t> stack;
-        bool keyf = true;
+    // обычный float 4 байта, dec - для вывода
+    BS& _float(float value, uint8_t dec) {
+        _self().push(BS_FLOAT | dec);
+        _self().write(&value, BS_FLOAT_SIZE);
+        return _self();
+    }
+
+    BS& _code(uint16_t code) {
+        _self().push(BS_CODE | BS_D16_MSB(code));
+        _self().push(BS_D16_LSB(code));
+        return _self();
+    }
+
+    BS& _key(const char* str, size_t len, bool pgm = false) {
+        _self()._keyed();
+        if (_dict && !pgm) {
+            int code = _dict->find(str, len);
+            if (code >= 0) return _code(code);
+        }
+        return addStr(str, len > BS_MAX_LEN ? BS_MAX_LEN : len, pgm);  // ключи - только короткие строки
+    }
 
-        auto isClose = [](const uint8_t* bson, const uint8_t* end) -> bool {
-            return (bson != end) && (*bson & (BS_CONTAINER | BS_CONT_CLOSE)) == (BS_CONTAINER | BS_CONT_CLOSE);
-        };
+    // заголовок строки или бинарных данных, длиннее BS_MAX_LEN - с длиной 4 байта
+    void _lenHead(uint8_t type, size_t len) {
+        if (len > BS_MAX_LEN) {
+            uint32_t n = len;
+            _self().push(type == BS_STRING ? BS_STR_EXT : BS_BIN_EXT);
+            _self().write(&n, BS_EXT_LEN);
+        } else {
+            _self().push(type | BS_D16_MSB(len));
+            _self().push(BS_D16_LSB(len));
+        }
+    }
 
-        while (bson != end) {
-            uint8_t type = BS_TYPE(*bson);
-            uint8_t data = BS_DATA(*bson);
+    void _open(uint8_t cont) {
+        _self().push(cont);
+    }
 
-            if (pretty && keyf) {
-                bool close = isClose(bson, end);
-                if (close) p.println();
-                for (int i = 0; i < (int)stack.length() - close; i++) p.print("   ");
-            }
+    void _close(uint8_t cont) {
+        _self().push(cont);
+    }
 
-            ++bson;
-
-            switch (type) {
-                case BS_CONTAINER:
-                    if (data & BS_CONT_OPEN) {
-                        char t = (data & BS_CONT_OBJ) ? '{' : '[';
-                        stack.push(t);
-                        p.print(t);
-                        if (pretty) p.println();
-                    } else {
-                        char t = (data & BS_CONT_OBJ) ? '}' : ']';
-                        p.print(t);
-                        if ((bson != end) && !(*bson & (BS_CONTAINER | BS_CONT_CLOSE))) pretty ? p.print(",\r\n") : p.print(',');
-                        stack.pop();
-                    }
-                    keyf = true;
-                    continue;
-
-                case BS_STRING: {
-                    uint16_t len = BS_D16_MERGE(data, *bson++);
-                    p.print('"');
-                    while (len--) p.write(*bson++);
-                    p.print('"');
-                } break;
-
-                case BS_BOOLEAN:
-                    p.print(BS_BOOLV(data) ? "true" : "false");
-                    break;
+    // перед записью ключа
+    void _keyed() {}
 
-                case BS_NULL:
-                    p.print("null");
-                    break;
+    static const char* _jScan(const char* p, const char* end);
+    static bool _jStr(const char*& p, const char* end, BSStack<char>& buf, const char*& str, size_t& len);
+    bool _jNum(const char*& p, const char* end);
 
-                case BS_INTEGER: {
-                    if (BS_NEGATIVE(data)) p.print('-');
-                    uint32_t v = 0;
-                    uint8_t size = BS_SIZE(data);
-                    memcpy(&v, bson, size > 4 ? 4 : size);  // todo 64
-                    bson += size;
-                    p.print(v);
-                } break;
-
-                case BS_FLOAT: {
-                    float v;
-                    memcpy(&v, bson, BS_FLOAT_SIZE);
-                    bson += BS_FLOAT_SIZE;
-                    p.print(v, BS_DECIMAL(data));
-                } break;
-
-                case BS_CODE:
-                    p.print("\"#");
-                    p.print(BS_D16_MERGE(data, *bson++));
-                    p.print('"');
-                    break;
+    BS& _int(const void* p, uint8_t size, bool neg = false) {
+        uint8_t len = uintSize((uint8_t*)p, size);
+        _self().push(BS_INTEGER | (neg ? BS_NEG_MASK : 0) | len);
+        _self().write(p, len);
+        return _self();
+    }
+};
+
+// ============== BSON ==============
+class BSON : public BSBuilder<BSON>, private BS_STACK {
+    typedef BS_STACK ST;
+    typedef BSBuilder<BSON> BD;
+    friend class BSBuilder<BSON>;
+
+   public:
+    using BD::add;
+    using BD::addBin;
+    using BD::addArray;
+    using BD::addNull;
+    using BD::addStr;
+    using BD::beginBin;
+    using BD::beginStr;
+    using BD::fromJson;
+    using BD::uintSize;
+    using BD::operator=;
+    using BD::operator+=;
+    using BD::operator[];
+    using BD::operator();
+    using BD::setDictionary;
+
+    typedef BSDictionary Dictionary;
+
+#ifdef BSON_USE_VECTOR
+    BSON() {}
+    BSON(const BSON&) = default;
+    BSON& operator=(const BSON&) = default;
+
+    // перемещение: буфер передаётся без копирования
+    BSON(BSON&&) noexcept = default;
+    BSON& operator=(BSON&&) noexcept = default;
+
+    void reserve(size_t len) {
+        BS_STAT(_Grow g(*this));
+        ST::reserve(len);
+    }
+    void push(uint8_t v) {
+        BS_STAT(_Grow g(*this));
+        ST::push_back(v);
+    }
+    uint8_t* buf() { return ST::data(); }
+    size_t length() { return ST::size(); }
+    bool concat(const ST& st) {
+        BS_STAT(_Grow g(*this));
+        ST::reserve(ST::size() + st.size());
+        ST::insert(ST::end(), st.begin(), st.end());
+        return true;
+    }
+    size_t write(const void* data, size_t len) {
+        BS_STAT(_Grow g(*this));
+        const uint8_t* p = (const uint8_t*)data;
+        ST::reserve(ST::size() + len);
+        ST::insert(ST::end(), p, p + len);
+        return len;
+    }
+    size_t write(const void* data, size_t len, bool) {
+        return write(data, len);
+    }
+    size_t write(const uint8_t* data, size_t len) {
+        return write((const void*)data, len);
+    }
+    operator uint8_t*() {
+        return ST::data();
+    }
+    void setOversize(uint8_t) {}
+#else
+    using ST::buf;
+    using ST::length;
+    using ST::move;
+    using ST::setOversize;
+    using ST::operator uint8_t*;
+#ifdef BSON_STATS
+    bool reserve(size_t len) {
+        _Grow g(*this);
+        return ST::reserve(len);
+    }
+    bool push(uint8_t v) {
+        _Grow g(*this);
+        return ST::push(v);
+    }
+    bool concat(const ST& st) {
+        _Grow g(*this);
+        return ST::concat(st);
+    }
+    bool concat(const uint8_t* data, size_t len, bool pgm = false) {
+        _Grow g(*this);
+        return ST::concat(data, len, pgm);
+    }
+    size_t write(const void* data, size_t len, bool pgm = false) {
+        _Grow g(*this);
+        return ST::write(data, len, pgm);
+    }
+#else
+    using ST::concat;
+    using ST::reserve;
+    using ST::write;
+#endif
+#endif
+
+    // очистить
+    void clear() {
+        ST::clear();
+        _conts.clear();
+    }
 
-                case BS_BINARY: {
-                    uint16_t len = BS_D16_MERGE(data, *bson++);
-                    bson += len;
-                    p.print("\"<bin:");
-                    p.print(len);
-                    p.print(">\"");
-                } break;
+#ifdef BSON_STATS
+    // ============== stats ==============
+    // счётчики: выделения памяти, вложенность, время stringify
+    const BSStats& stats() const {
+        return _stats;
+    }
+
+    // обнулить счётчики
+    void resetStats() {
+        _stats.reset();
+    }
+#endif
+
+    class Parser;
+    class Index;
+    class StreamParser;
+    class Writer;
+    class Fixed;
+    class Gather;
+    class Pool;
+    class Counter;
+    class Editor;
+    class LogWriter;
+    class LogReader;
+    class Scanner;
+    class Query;
+    class Compressor;
+    class Decompressor;
+
+    // ================ static ================
+    // максимальная длина строк и бинарных данных
+    static size_t maxDataLength() {
+        return (sizeof(size_t) > 4) ? BS_MAX_EXT_LEN : size_t(-1);
+    }
+
+    // максимальная длина строк и бинарных данных с длиной в заголовке (ключи - не длиннее)
+    static size_t maxShortLength() {
+        return BS_MAX_LEN;
+    }
+
+    // размер блока значения, как его запишет add(val)
+    template <typename T>
+    static size_t sizeOf(const T& val);
+
+    // размер блока float, как его запишет b = val
+    static size_t sizeOf(float val);
+    static size_t sizeOf(double val);
+
+    // размер блока float, как его запишет add(val, dec)
+    static size_t sizeOf(double val, int dec);
+
+    // размер блока строки
+    static size_t sizeOf(const char* str, size_t len);
+
+    // размер блока бинарных данных
+    static size_t sizeOfBin(size_t len);
+
+    // размер типизированного массива из len элементов T
+    template <typename T>
+    static size_t sizeOfArray(size_t len);
+
+    // проверить структуру пакета без парсинга значений. errPos - позиция ошибки.
+    // Память не выделяется, вложенность контейнеров - до BS_VALIDATE_DEPTH
+    static bool validate(const uint8_t* bson, size_t len, size_t* errPos = nullptr) {
+        const uint8_t* p = bson;
+        const uint8_t* end = bson + len;
+        uint32_t stack[BS_VALIDATE_DEPTH];  // конец контейнера с размером + 1 | _V_OBJ
+        uint16_t depth = 0;
+        uint8_t obj = 0;
+        uint32_t cend = 0;
+        bool val = false;
+
+        while (p < end) {
+            uint8_t h = *p;
+            uint8_t c = _vclass(h);
+
+            if (c < _V_OPEN) {  // простое значение - основной случай
+                if (obj) {
+                    if (!val && !(c & _V_KEY)) break;
+                    val = !val;
+                }
+                size_t n = 1 + (c & _V_SIZE);
+                if (c & _V_VAR) {
+                    if (end - p < 2) break;
+                    n += BS_D16_MERGE(BS_DATA(h), p[1]);
+                }
+                if (size_t(end - p) < n) break;
+                p += n;
+                continue;
+            }
+            if (c == _V_ERR) break;
+
+            if (c == _V_TARR) {
+                if (obj && !val) break;
+                size_t n = _taLen(p, end - p);
+                if (!n) break;
+                p += n;
+                if (obj) val = false;
+                continue;
             }
 
-            if (stack.last() == '{') {
-                if (keyf) p.print(':');
-                else if (!isClose(bson, end)) pretty ? p.print(",\r\n") : p.print(',');
-                keyf ^= 1;
-            } else {
-                if (!isClose(bson, end)) pretty ? p.print(",\r\n") : p.print(',');
+            if (c == _V_SOBJ) {
+                if ((obj && !val) || end - p < 1 + BS_CONT_SIZE_LEN + BS_SOBJ_CNT_LEN) break;
+                uint32_t size;
+                uint16_t cnt;
+                memcpy(&size, p + 1, BS_CONT_SIZE_LEN);
+                memcpy(&cnt, p + 1 + BS_CONT_SIZE_LEN, BS_SOBJ_CNT_LEN);
+                p += 1 + BS_CONT_SIZE_LEN;
+                uint32_t table = BS_SOBJ_CNT_LEN + uint32_t(cnt) * BS_SOBJ_OFFS_LEN;
+                if (size >= size_t(end - p) || table > size) break;
+
+                uint32_t off = 0, prev = 0, i = 0;  // смещения возрастают и не выходят за пары
+                for (; i < cnt; i++) {
+                    memcpy(&off, p + BS_SOBJ_CNT_LEN + i * BS_SOBJ_OFFS_LEN, BS_SOBJ_OFFS_LEN);
+                    if ((i ? off <= prev : off != 0) || off >= size - table) break;
+                    prev = off;
+                }
+                if (i != cnt || depth == BS_VALIDATE_DEPTH) break;
+
+                stack[depth++] = cend | (obj ? _V_OBJ : 0);
+                cend = (p - bson) + size + 1;
+                p += table;
+                obj = BS_CONT_OBJ;
+                val = false;
+                continue;
             }
+
+            if (c == _V_EXT) {
+                if ((obj && !val) || size_t(end - p) < 1 + BS_EXT_LEN) break;
+                uint32_t n;
+                memcpy(&n, p + 1, BS_EXT_LEN);
+                if (n > size_t(end - p) - 1 - BS_EXT_LEN) break;
+                p += 1 + BS_EXT_LEN + n;
+                if (obj) val = false;
+                continue;
+            }
+
+            if (c == _V_FEXT) {
+                if ((obj && !val) || end - p < 2 || BSFloat::extSize(p[1]) < 0 || end - p < 2 + BSFloat::extSize(p[1])) break;
+                p += 2 + BSFloat::extSize(p[1]);
+                if (obj) val = false;
+                continue;
+            }
+
+            if (c & _V_CLOSE) {
+                if (!depth || (h & BS_CONT_OBJ) != obj || val) break;
+                if (cend && uint32_t(p - bson) + 1 != cend) break;
+                uint32_t prev = stack[--depth];
+                obj = (prev & _V_OBJ) ? BS_CONT_OBJ : 0;
+                cend = prev & ~_V_OBJ;
+                val = false;
+                ++p;
+                continue;
+            }
+            // открытие контейнера
+            if (obj && !val) break;
+            size_t n = 1 + (c & _V_SIZE);
+            if (size_t(end - p) < n || depth == BS_VALIDATE_DEPTH) break;
+            p += n;
+
+            stack[depth++] = cend | (obj ? _V_OBJ : 0);
+            cend = 0;
+            if (h & BS_CONT_SIZED) {
+                uint32_t size;
+                memcpy(&size, p - BS_CONT_SIZE_LEN, BS_CONT_SIZE_LEN);
+                if (size >= size_t(end - p)) break;
+                cend = (p - bson) + size + 1;
+            }
+            obj = h & BS_CONT_OBJ;
+            val = false;
         }
-        p.println();
+
+        if (p == end && !depth && !val) return true;
+        if (errPos) *errPos = (p < end) ? p - bson : len;
+        return false;
+    }
+
+    // проверить структуру пакета без парсинга значений. errPos - позиция ошибки
+    static bool validate(BSON& bson, size_t* errPos = nullptr) {
+        return validate(bson.buf(), bson.length(), errPos);
+    }
+
+    // ============== patch ==============
+    // дописать в patch разницу между пакетами: [ {"путь": значение, ...}, ["удалённый путь", ...] ].
+    // В каждом пакете - одно корневое значение, иначе false. Новые ключи дописываются в конец объекта
+    static bool diff(const uint8_t* prev, size_t plen, const uint8_t* cur, size_t clen, BSON& patch, const BSDictionary* dict = nullptr);
+
+    // дописать в patch разницу между пакетами
+    static bool diff(BSON& prev, BSON& cur, BSON& patch, const BSDictionary* dict = nullptr) {
+        return diff(prev.buf(), prev.length(), cur.buf(), cur.length(), patch, dict);
+    }
+
+    // применить патч к пакету base. Вернёт false при ошибке в патче или пути
+    static bool applyPatch(BSON& base, const uint8_t* patch, size_t len, const BSDictionary* dict = nullptr);
+
+    // применить патч к пакету base. Вернёт false при ошибке в патче или пути
+    static bool applyPatch(BSON& base, BSON& patch, const BSDictionary* dict = nullptr) {
+        return applyPatch(base, patch.buf(), patch.length(), dict);
+    }
+
+    // ============== compress ==============
+    // сжать пакет и дописать в out. dict - словарь ключей, тот же при распаковке
+    static bool compress(const uint8_t* bson, size_t len, BSON& out, const BSDictionary* dict = nullptr);
+
+    // сжать пакет и дописать в out
+    static bool compress(BSON& bson, BSON& out, const BSDictionary* dict = nullptr) {
+        return compress(bson.buf(), bson.length(), out, dict);
+    }
+
+    // распаковать данные и дописать в out. Вернёт false при ошибке в данных
+    static bool decompress(const uint8_t* data, size_t len, BSON& out, const BSDictionary* dict = nullptr);
+
+    // распаковать данные и дописать в out
+    static bool decompress(BSON& data, BSON& out, const BSDictionary* dict = nullptr) {
+        return decompress(data.buf(), data.length(), out, dict);
+    }
+
+    // ============== add bson ==============
+    BSON& add(const BSON& bson) {
+        concat(bson);
+        return *this;
+    }
+    void operator+=(const BSON& bson) { add(bson); }
+
+    // контейнеры с размером, парсер пропускает их за O(1). Менять между пакетами
+    void setSized(bool sized) {
+        _sized = sized;
+    }
+
+    // канонические объекты: пары сортируются по ключу при закрытии объекта, объект получает таблицу смещений
+    // для двоичного поиска Parser::find(). Одинаковые данные дают одинаковые пакеты. Менять между пакетами
+    void setSorted(bool sorted) {
+        _sorted = sorted;
+    }
+
+// ============== stringify ==============
+    // JSON в буфер json размером size с нулём в конце. Вернёт длину JSON, при нехватке места больше size - 1 (как snprintf)
+    size_t stringify(char* json, size_t size, bool pretty = false, const BSDictionary* dict = nullptr) {
+        BS_STAT(BSStats::Timer t(&_stats));
+        return _jsonTo(buf(), length(), json, size, pretty, dict);
+    }
+
+    // дописать JSON в out (без нуля в конце). Вернёт false при ошибке выделения памяти
+    bool stringify(BSStack<char>& out, bool pretty = false, const BSDictionary* dict = nullptr) {
+        BS_STAT(BSStats::Timer t(&_stats));
+        return _jsonTo(buf(), length(), out, pretty, dict);
+    }
+
+    // JSON в буфер json размером size с нулём в конце. Вернёт длину JSON, при нехватке места больше size - 1 (как snprintf)
+    static size_t stringify(const uint8_t* bson, size_t len, char* json, size_t size, bool pretty = false, const BSDictionary* dict = nullptr) {
+        BS_STAT(BSStats::Timer t(nullptr));
+        return _jsonTo(bson, len, json, size, pretty, dict);
+    }
+
+    // дописать JSON в out (без нуля в конце). Вернёт false при ошибке выделения памяти
+    static bool stringify(const uint8_t* bson, size_t len, BSStack<char>& out, bool pretty = false, const BSDictionary* dict = nullptr) {
+        BS_STAT(BSStats::Timer t(nullptr));
+        return _jsonTo(bson, len, out, pretty, dict);
+    }
+
+#ifdef ARDUINO
+    // вывести в Print как JSON. dict - словарь для кодов
+    void stringify(Print& p, bool pretty = false, const BSDictionary* dict = nullptr) {
+        stringify(*this, p, pretty, dict);
+    }
+
+    // вывести в Print как JSON. dict - словарь для кодов
+    static void stringify(BSON& bson, Print& p, bool pretty = false, const BSDictionary* dict = nullptr) {
+        BS_STAT(BSStats::Timer t(&bson._stats));
+        _jsonTo(bson.buf(), bson.length(), p, pretty, dict);
+    }
+
+    // вывести в Print как JSON. dict - словарь для кодов
+    static void stringify(const uint8_t* bson, size_t len, Print& p, bool pretty = false, const BSDictionary* dict = nullptr) {
+        BS_STAT(BSStats::Timer t(nullptr));
+        _jsonTo(bson, len, p, pretty, dict);
     }
 #endif
 
     // ============== private ==============
    private:
-    BSON& _int(const void* p, uint8_t size, bool neg = false) {
-        uint8_t len = uintSize((uint8_t*)p, size);
-        push(BS_INTEGER | (neg ? BS_NEG_MASK : 0) | len);
-        write(p, len);
-        return *this;
+    BSStack<uint32_t> _conts;
+    bool _sized = false;
+    bool _sorted = false;
+
+    struct _Patch;
+    struct _Lz;
+
+#ifdef BSON_STATS
+    BSStats::Local _stats;
+
+    // учёт выделений памяти буфера на время записи
+    struct _Grow {
+        BSON& b;
+#ifdef BSON_USE_VECTOR
+        size_t cap;
+
+        _Grow(BSON& b) : b(b), cap(b.ST::capacity()) {}
+        ~_Grow() {
+            if (b.ST::capacity() > cap) b._stats.grow(b.ST::capacity() - cap);
+        }
+#else
+        // ёмкость GTL недоступна: выделением считается перенос буфера, рост - от длины при прошлом переносе
+        uint8_t* buf;
+
+        _Grow(BSON& b) : b(b), buf(b.buf()) {}
+        ~_Grow() {
+            if (b.buf() == buf) return;
+            b._stats.grow(b.length() > b._high ? b.length() - b._high : 0);
+            b._high = b.length();
+        }
+#endif
+    };
+#ifndef BSON_USE_VECTOR
+    size_t _high = 0;
+#endif
+#endif
+
+    // изменить длину, новые байты - нули. false - не хватило памяти, буфер мог частично вырасти
+    bool _resize(size_t len) {
+#ifdef BSON_USE_VECTOR
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+        try {
+            ST::resize(len);
+        } catch (...) {
+            return false;
+        }
+#else
+        ST::resize(len);
+#endif
+        return true;
+#else
+        while (length() > len) ST::pop();
+        if (length() < len && !reserve(len)) return false;
+        while (length() < len) {
+            if (!push(0)) return false;
+        }
+        return true;
+#endif
+    }
+
+    struct _JBuf {
+        char* buf;
+        size_t size;
+        size_t len;
+
+        void write(const char* s, size_t n) {
+            if (len < size) memcpy(buf + len, s, (size - len < n) ? size - len : n);
+            len += n;
+        }
+    };
+
+    struct _JStack {
+        BSStack<char>& out;
+        bool ok;
+
+        void write(const char* s, size_t n) {
+            if (ok && !out.concat(s, n)) ok = false;
+        }
+    };
+
+#ifdef ARDUINO
+    struct _JPrint {
+        Print& p;
+
+        void write(const char* s, size_t n) {
+            p.write((const uint8_t*)s, n);
+        }
+    };
+#endif
+
+    static size_t _jsonTo(const uint8_t* bson, size_t len, char* json, size_t size, bool pretty, const BSDictionary* dict) {
+        _JBuf out{json, size, 0};
+        _stringify(bson, len, out, pretty, dict, "\n");
+        if (size) json[out.len < size ? out.len : size - 1] = 0;
+        return out.len;
+    }
+
+    static bool _jsonTo(const uint8_t* bson, size_t len, BSStack<char>& out, bool pretty, const BSDictionary* dict) {
+        _JStack o{out, true};
+        _stringify(bson, len, o, pretty, dict, "\n");
+        return o.ok;
+    }
+
+#ifdef ARDUINO
+    static void _jsonTo(const uint8_t* bson, size_t len, Print& p, bool pretty, const BSDictionary* dict) {
+        _JPrint out{p};
+        _stringify(bson, len, out, pretty, dict, "\r\n");
+        p.println();
+    }
+#endif
+
+    template <typename Out>
+    static void _stringify(const uint8_t* bson, size_t len, Out& out, bool pretty, const BSDictionary* dict, const char* eol);
+
+    template <typename Out>
+    static void _jsonStr(Out& out, const char* str, size_t len);
+
+    static uint8_t _jsonUint(char* end, uint64_t v);
+    static uint8_t _jsonFloat(char* buf, double v, uint8_t dec);
+    static uint8_t _jsonElem(char* buf, const uint8_t* p, uint8_t type);
+
+    void _open(uint8_t cont) {
+        BS_STAT(_stats.open());
+        bool sorted = _sorted && cont == BS_OBJ_OPEN;
+        if (_sized || sorted) {
+            push(sorted ? BS_SOBJ_OPEN : (cont | BS_CONT_SIZED));
+            _conts.push(length());
+            uint8_t zero[BS_CONT_SIZE_LEN + BS_SOBJ_CNT_LEN] = {};  // размер и количество пар
+            write(zero, sorted ? sizeof(zero) : BS_CONT_SIZE_LEN);
+        } else {
+            push(cont);
+        }
+    }
+
+    void _close(uint8_t cont) {
+        BS_STAT(_stats.close());
+        bool sorted = _sorted && cont == BS_OBJ_CLOSE;
+        if ((_sized || sorted) && _conts.length()) {
+            uint32_t pos = _conts.pop();
+            if (sorted && !_sort(pos)) _unsort(pos);
+            uint32_t size = length() - pos - BS_CONT_SIZE_LEN;
+            memcpy(buf() + pos, &size, BS_CONT_SIZE_LEN);
+        }
+        push(cont);
+    }
+
+    // отсортировать пары объекта, pos - позиция размера
+    bool _sort(uint32_t pos);
+
+    // объект не отсортировать: обычный объект с размером, без количества пар
+    void _unsort(uint32_t pos) {
+        uint32_t base = pos + BS_CONT_SIZE_LEN;
+        buf()[pos - 1] = BS_OBJ_OPEN | BS_CONT_SIZED;
+        memmove(buf() + base, buf() + base + BS_SOBJ_CNT_LEN, length() - base - BS_SOBJ_CNT_LEN);
+        _resize(length() - BS_SOBJ_CNT_LEN);
+    }
+
+    // порядок ключей отсортированного объекта
+    static int _keyCmp(const char* a, size_t alen, const char* b, size_t blen) {
+        int c = memcmp(a, b, alen < blen ? alen : blen);
+        return c ? c : (alen < blen ? -1 : (alen > blen));
+    }
+
+    enum : uint8_t {
+        _V_SIZE = 0x0f,   // размер данных после заголовка
+        _V_VAR = 0x10,    // + длина в заголовке [String, Binary]
+        _V_KEY = 0x20,    // может быть ключом [String, Code]
+        _V_OPEN = 0x40,   // открытие контейнера
+        _V_CLOSE = 0x80,  // закрытие контейнера
+        _V_TARR = 0xc0,   // типизированный массив
+        _V_FEXT = 0xa0,   // float с байтом формы
+        _V_SOBJ = 0xe0,   // отсортированный объект
+        _V_EXT = 0x90,    // длинная строка или бинарные данные
+        _V_ERR = 0xff,
+    };
+    static const uint32_t _V_OBJ = 0x80000000ul;
+
+    // полный размер типизированного массива или 0 при ошибке
+    static size_t _taLen(const uint8_t* p, size_t len) {
+        if (len < 2) return 0;
+        uint8_t t = p[1];
+        uint8_t size = BS_TA_SIZE(t);
+        uint8_t cl = BS_TA_CNT_LEN(t);
+        if (cl > 4 || (size != 1 && size != 2 && size != 4 && size != 8) || ((t & BS_TA_FLOAT) && size < 4)) return 0;
+        if (len < 2u + cl) return 0;
+        uint32_t n = 0;
+        memcpy(&n, p + 2, cl);
+        uint64_t total = 2 + cl + uint64_t(n) * size;
+        return total <= len ? size_t(total) : 0;
+    }
+
+    // класс заголовка для validate
+    static constexpr uint8_t _vcalc(uint8_t h) {
+        return BS_TYPE(h) == BS_STRING    ? (_V_VAR | _V_KEY | 1)
+               : BS_TYPE(h) == BS_BINARY  ? (_V_VAR | 1)
+               : BS_TYPE(h) == BS_CODE    ? (_V_KEY | 1)
+               : BS_TYPE(h) == BS_BOOLEAN ? (BS_DATA(h) > 1 ? _V_ERR : 0)
+               : BS_TYPE(h) == BS_INTEGER ? (BS_SIZE(h) > 8 ? _V_ERR : BS_SIZE(h))
+               : BS_TYPE(h) == BS_FLOAT   ? ((h & BS_FLOAT_EXT) ? _V_FEXT : BS_FLOAT_SIZE)
+               : (h == BS_STR_EXT || h == BS_BIN_EXT)    ? _V_EXT
+               : BS_TYPE(h) == BS_NULL    ? (BS_DATA(h) ? _V_ERR : 0)
+               : (h == BS_SOBJ_OPEN)                      ? _V_SOBJ
+               : (h == BS_OBJ_OPEN || h == BS_ARR_OPEN)   ? _V_OPEN
+               : ((h & ~BS_CONT_SIZED) == BS_OBJ_OPEN || (h & ~BS_CONT_SIZED) == BS_ARR_OPEN) ? (_V_OPEN | BS_CONT_SIZE_LEN)
+               : (h == BS_OBJ_CLOSE || h == BS_ARR_CLOSE) ? _V_CLOSE
+               : (h == BS_TYPED_ARR)                      ? _V_TARR
+                                                          : _V_ERR;
+    }
+
+    static uint8_t _vclass(uint8_t h) {
+#ifdef __AVR__
+        return _vcalc(h);
+#else
+#define _BS_VT4(i) _vcalc(i), _vcalc(i + 1), _vcalc(i + 2), _vcalc(i + 3)
+#define _BS_VT16(i) _BS_VT4(i), _BS_VT4(i + 4), _BS_VT4(i + 8), _BS_VT4(i + 12)
+#define _BS_VT64(i) _BS_VT16(i), _BS_VT16(i + 16), _BS_VT16(i + 32), _BS_VT16(i + 48)
+        static const uint8_t tab[256] = {_BS_VT64(0), _BS_VT64(64), _BS_VT64(128), _BS_VT64(192)};
+#undef _BS_VT4
+#undef _BS_VT16
+#undef _BS_VT64
+        return tab[h];
+#endif
     }
 };
 
@@ -383,26 +1055,80 @@ enum class BSType : uint8_t {
     Binary = BS_BINARY,
     Container = BS_CONTAINER,
     Null = BS_NULL,
+    TypedArray = BS_TYPED_ARR,
     Error = 0xff,
 };
 
+// массив в буфере пакета. Данные не выровнены, operator[] читает через memcpy
+template <typename T>
+struct BSSpan {
+    const T* data = nullptr;
+    size_t length = 0;
+
+    T operator[](size_t i) const {
+        T t;
+        memcpy(&t, data + i, sizeof(T));
+        return t;
+    }
+};
+
 // ============== PARSER ==============
 // линейный парсер BSON
 class BSON::Parser {
+    friend class BSON;
+    friend class BSON::Index;
+    friend class BSON::Editor;
+    friend struct BSON::_Patch;
+    friend class BSON::Scanner;
+    friend class BSON::Query;
+
    public:
-    Parser(uint8_t* bson, uint16_t len) : _bson(bson), _cur(bson), _end(bson + len) {}
+    Parser(uint8_t* bson, size_t len) : _bson(bson), _cur(bson), _end(bson + len) {}
     Parser(BSON* b) : Parser(b->buf(), b->length()) {}
     Parser(BSON& b) : Parser(&b) {}
 
+    // словарь: коды из словаря в позиции ключа парсятся как строки [String], toCode() вернёт код.
+    // Коды-значения остаются кодами. nullptr - отключить
+    void setDictionary(const BSDictionary* dict) {
+        _dict = dict;
+    }
+
     // начать заново
     void reset() {
         _cur = _bson;
+        _objs = 0;
+        _key = false;
+    }
+
+    // JSON в буфер json размером size с нулём в конце. Вернёт длину JSON (как snprintf)
+    size_t stringify(char* json, size_t size, bool pretty = false) {
+        BS_STAT(BSStats::Timer t(&_stats));
+        return BSON::_jsonTo(_bson, _end - _bson, json, size, pretty, _dict);
     }
 
-#if defined(ARDUINO) && !defined(BSON_USE_VECTOR)
+    // дописать JSON в out. Вернёт false при ошибке выделения памяти
+    bool stringify(BSStack<char>& out, bool pretty = false) {
+        BS_STAT(BSStats::Timer t(&_stats));
+        return BSON::_jsonTo(_bson, _end - _bson, out, pretty, _dict);
+    }
+
+#ifdef ARDUINO
     // вывести в Print как JSON
     void stringify(Print& p, bool pretty = false) {
-        BSON::stringify(_bson, _end - _bson, p, pretty);
+        BS_STAT(BSStats::Timer t(&_stats));
+        BSON::_jsonTo(_bson, _end - _bson, p, pretty, _dict);
+    }
+#endif
+
+#ifdef BSON_STATS
+    // счётчики: блоки и байты по типам, вложенность, ошибки по причинам, время stringify
+    const BSStats& stats() const {
+        return _stats;
+    }
+
+    // обнулить счётчики
+    void resetStats() {
+        _stats.reset();
     }
 #endif
 
@@ -433,8 +1159,13 @@ class BSON::Parser {
         return (_type == BSType::Container) ? (_data & BS_CONT_CLOSE) : false;
     }
 
-    // длина в байтах [String, Binary, Integer]
-    uint16_t length() const {
+    // объект отсортирован, доступен двоичный поиск find() [Container]
+    bool isSorted() const {
+        return isOpen() && *_hdr == BS_SOBJ_OPEN;
+    }
+
+    // длина в байтах [String, Binary, Integer], количество элементов [TypedArray]
+    size_t length() const {
         switch (_type) {
             case BSType::String:
             case BSType::Binary:
@@ -443,6 +1174,9 @@ class BSON::Parser {
             case BSType::Integer:
                 return BS_SIZE(_data);
 
+            case BSType::TypedArray:
+                return _count;
+
             default:
                 return 0;
         }
@@ -460,6 +1194,11 @@ class BSON::Parser {
         return (_type == BSType::String) ? (const char*)_dataP() : "";
     }
 
+    // указатель на данные в буфере пакета [String, Binary], длина length()
+    const uint8_t* toData() const {
+        return (_type == BSType::String || _type == BSType::Binary) ? (const uint8_t*)_dataP() : nullptr;
+    }
+
 #ifndef BSON_NO_TEXT
     // в текст [String]
     Text toText() const {
@@ -478,7 +1217,7 @@ class BSON::Parser {
     // в код [Code]
     template <typename T>
     T toCode() const {
-        return (_type == BSType::Code) ? T(_data) : T(0);
+        return (_type == BSType::Code) ? T(_data) : (_str ? T(_code) : T(0));
     }
 
     // в bool [Boolean]
@@ -508,9 +1247,24 @@ class BSON::Parser {
 
     // в float [Float]
     float toFloat() const {
-        float f;
-        if (_type == BSType::Float) memcpy(&f, _dataP(), _data);
-        return f;
+        return toDouble();
+    }
+
+    // в double [Float]
+    double toDouble() const {
+        return (_type == BSType::Float) ? BSFloat::read(_head, (const uint8_t*)_dataP()) : 0;
+    }
+
+    // массив в буфере пакета, без копирования. Тип T должен совпадать с записанным [TypedArray]
+    template <typename T>
+    BSSpan<T> toSpan() const {
+        static_assert(BS_TA_VALID(T), "toSpan: integers of 1, 2, 4, 8 bytes, float or double");
+        BSSpan<T> s;
+        if (_type == BSType::TypedArray && BS_TA_ELEM(_data) == BS_TA_TYPE(T)) {
+            s.length = _count;
+            s.data = (const T*)(_cur - s.length * sizeof(T));
+        }
+        return s;
     }
 
     // ============ PARSING ============
@@ -544,12 +1298,16 @@ class BSON::Parser {
     }
 
     bool readFloat(float* f) {
-        return next(BSType::Float) ? (memcpy(f, _dataP(), _data), true) : false;
+        return next(BSType::Float) ? (*f = toFloat(), true) : false;
+    }
+
+    bool readDouble(double* f) {
+        return next(BSType::Float) ? (*f = toDouble(), true) : false;
     }
 
     template <typename T>
     bool readCode(T* c) {
-        return next(BSType::Code) ? (*c = T(_data), true) : false;
+        return (next() && (_type == BSType::Code || _str)) ? (*c = toCode<T>(), true) : false;
     }
 
     template <typename T>
@@ -563,6 +1321,34 @@ class BSON::Parser {
         return true;
     }
 
+    // прочитать объект в структуру с BSON_FIELDS. Поля ищутся сначала по порядку, неизвестные ключи пропускаются
+    template <typename T>
+    bool decode(T& t) {
+        if (!next('{')) return false;
+        _Dec d{*this, nullptr, 0, 0, false, false, true};
+
+        while (next()) {
+            if (_type == BSType::Container) return isClose() && isObject();
+            if (_type != BSType::String) return false;
+
+            d.key = toStr();
+            d.len = _data;
+            d.found = false;
+            d.pos = true;
+            t.bsonFields(d);
+            if (!d.found) {
+                d.pos = false;
+                t.bsonFields(d);
+            }
+            if (!d.found) {
+                if (!next() || !skip()) return false;
+            } else if (!d.ok) {
+                return false;
+            }
+        }
+        return false;
+    }
+
     // ============= NEXT =============
 
     // true - парсинг окончен корректно
@@ -578,11 +1364,12 @@ class BSON::Parser {
     // парсить следующий блок и проверить контейнер [ ] { }. Вернёт true при успехе
     bool next(char cont) {
         if (!next(BSType::Container)) return false;
+        uint8_t data = _data & ~BS_CONT_SIZED;
         switch (cont) {
-            case '[': return _data == (BS_CONT_ARR | BS_CONT_OPEN);
-            case ']': return _data == (BS_CONT_ARR | BS_CONT_CLOSE);
-            case '{': return _data == (BS_CONT_OBJ | BS_CONT_OPEN);
-            case '}': return _data == (BS_CONT_OBJ | BS_CONT_CLOSE);
+            case '[': return data == (BS_CONT_ARR | BS_CONT_OPEN);
+            case ']': return data == (BS_CONT_ARR | BS_CONT_CLOSE);
+            case '{': return data == (BS_CONT_OBJ | BS_CONT_OPEN);
+            case '}': return data == (BS_CONT_OBJ | BS_CONT_CLOSE);
             default: return false;
         }
     }
@@ -591,13 +1378,39 @@ class BSON::Parser {
     bool next() {
         if (_ovf()) return false;
 
+        BS_STAT(uint8_t* start = _cur);
+        bool key = _key;
         uint8_t data = BS_DATA(*_cur);
         _type = (BSType)BS_TYPE(*_cur);
+        _str = nullptr;
         ++_cur;
 
         switch (_type) {
             case BSType::Container:
                 _data = data;
+                if (_cur[-1] == BS_TYPED_ARR) {
+                    size_t len = _taLen(_cur - 1, _end - _cur + 1);
+                    if (!len) return _abort(BSStats::Header);
+                    _type = BSType::TypedArray;
+                    _data = _cur[0];
+                    _count = (len - 2 - BS_TA_CNT_LEN(_data)) / BS_TA_SIZE(_data);
+                    _cur += len - 1;
+                    break;
+                }
+                _hdr = _cur - 1;
+                if (data & BS_CONT_SIZED) {
+                    if (_ovf(BS_CONT_SIZE_LEN)) return _abort(BSStats::Truncated);
+                    _cur += BS_CONT_SIZE_LEN;
+                }
+                if (*_hdr == BS_SOBJ_OPEN) {
+                    if (_ovf(BS_SOBJ_CNT_LEN)) return _abort(BSStats::Truncated);
+                    uint16_t cnt;
+                    memcpy(&cnt, _cur, BS_SOBJ_CNT_LEN);
+                    _count = cnt;
+                    if (_ovf(BS_SOBJ_CNT_LEN + _count * BS_SOBJ_OFFS_LEN)) return _abort(BSStats::Truncated);
+                    _cur += BS_SOBJ_CNT_LEN + _count * BS_SOBJ_OFFS_LEN;
+                    _data &= ~BS_CONT_ARR;
+                }
                 break;
 
             case BSType::Boolean:
@@ -605,53 +1418,240 @@ class BSON::Parser {
                 break;
 
             case BSType::Code:
-                if (_ovf()) return _abort();
+                if (_ovf()) return _abort(BSStats::Truncated);
                 _data = BS_D16_MERGE(data, *_cur++);
+                if (key && _dict && (_str = _dict->get(_data))) {
+                    _type = BSType::String;
+                    _code = _data;
+                    _data = strlen(_str);
+                }
                 break;
 
             case BSType::String:
             case BSType::Binary:
-                if (_ovf()) return _abort();
+                if (_ovf()) return _abort(BSStats::Truncated);
                 _data = BS_D16_MERGE(data, *_cur++);
-                if (_ovf(_data)) return _abort();
+                if (_ovf(_data)) return _abort(BSStats::Truncated);
                 _cur += _data;
                 break;
 
             case BSType::Integer:
                 _data = BS_SIZE(data);
-                if (_ovf(_data)) return _abort();
+                if (_ovf(_data)) return _abort(BSStats::Truncated);
                 _cur += _data;
                 _data = data;  // + neg
                 break;
 
             case BSType::Float:
+                _head = data;
                 _data = BS_FLOAT_SIZE;
-                if (_ovf(_data)) return _abort();
+                if (data & BS_FLOAT_EXT) {
+                    if (_ovf()) return _abort(BSStats::Truncated);
+                    if (BSFloat::extSize(*_cur) < 0) return _abort(BSStats::Header);
+                    _data = 1 + BSFloat::extSize(*_cur);
+                }
+                if (_ovf(_data)) return _abort(BSStats::Truncated);
                 _cur += _data;
                 break;
 
+            case BSType::Null:
+                if (data == BS_DATA(BS_STR_EXT) || data == BS_DATA(BS_BIN_EXT)) {
+                    if (_ovf(BS_EXT_LEN)) return _abort(BSStats::Truncated);
+                    uint32_t len;
+                    memcpy(&len, _cur, BS_EXT_LEN);
+                    _cur += BS_EXT_LEN;
+                    if (_ovf(len)) return _abort(BSStats::Truncated);
+                    _type = (data == BS_DATA(BS_STR_EXT)) ? BSType::String : BSType::Binary;
+                    _data = len;
+                    _cur += len;
+                }
+                break;
+
             default: break;
         }
 
+        if (_type == BSType::Container) {
+            _objs = (_data & BS_CONT_OPEN) ? (_objs << 1 | ((_data & BS_CONT_OBJ) ? 1 : 0)) : (_objs >> 1);
+            _key = _objs & 1;
+        } else {
+            _key = (_objs & 1) && !key;
+        }
+
+#ifdef BSON_STATS
+        _stats.token(_str ? BS_CODE : uint8_t(_type), _cur - start);
+        if (isOpen()) _stats.open();
+        else if (isClose()) _stats.close();
+#endif
         if (_cur == _end) _done = true;
         return _cur <= _end;
     }
 
+    // пропустить открытый контейнер целиком, парсер встанет на его закрытие.
+    // Контейнер с размером пропускается за O(1). Вернёт true при успехе
+    bool skip() {
+        if (!isOpen()) return _type != BSType::Error;
+
+        uint8_t cont = _data & BS_CONT_OBJ;
+        if (_data & BS_CONT_SIZED) {
+            uint32_t size;
+            uint8_t* start = _hdr + 1 + BS_CONT_SIZE_LEN;
+            memcpy(&size, _hdr + 1, BS_CONT_SIZE_LEN);
+            if (size > size_t(_end - start)) return _abort(BSStats::Container);
+            _cur = start + size;
+            if (!next() || !isClose()) return _abort(BSStats::Container);
+        } else {
+            while (next()) {
+                if (isOpen()) {
+                    if (!skip()) return false;
+                } else if (isClose()) {
+                    break;
+                }
+            }
+            if (!isClose()) return false;
+        }
+        return (_data & BS_CONT_OBJ) == cont ? true : _abort(BSStats::Container);
+    }
+
+    // найти ключ в объекте, парсер встанет перед значением. Сразу после открытия отсортированного объекта -
+    // двоичный поиск, иначе перебор от текущей позиции. Если ключа нет - встанет на закрытие и вернёт false
+    bool find(const char* key, size_t len) {
+        if (isOpen() && !isObject()) return false;
+        if (isSorted()) {
+            uint16_t cnt;
+            uint8_t* offs = _hdr + 1 + BS_CONT_SIZE_LEN + BS_SOBJ_CNT_LEN;
+            memcpy(&cnt, offs - BS_SOBJ_CNT_LEN, BS_SOBJ_CNT_LEN);
+            uint8_t* base = offs + cnt * BS_SOBJ_OFFS_LEN;
+            size_t lo = 0, hi = cnt;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                uint32_t off;
+                memcpy(&off, offs + mid * BS_SOBJ_OFFS_LEN, BS_SOBJ_OFFS_LEN);
+                if (off >= size_t(_end - base)) return _abort(BSStats::Table);
+
+                Parser k(base + off, _end - base - off);
+                k._dict = _dict;
+                k._inObject();
+                if (!k.next()) return _abort(BSStats::Table);
+                int c;
+                if (k._type == BSType::String) c = BSON::_keyCmp((const char*)k._dataP(), k._data, key, len);
+                else if (k._type == BSType::Code) c = BSON::_keyCmp((const char*)k._cur - 2, 2, key, len);
+                else return _abort(BSStats::Key);
+
+                if (!c) {
+                    _cur = k._cur;
+                    _type = BSType::String;
+                    _key = false;
+                    return true;
+                }
+                if (c < 0) lo = mid + 1;
+                else hi = mid;
+            }
+            return skip() && false;
+        }
+
+        while (next()) {
+            if (isClose()) return false;
+            if (_type == BSType::String && _data == len && !memcmp(_dataP(), key, len)) return true;
+            if (!next() || !skip()) return false;
+        }
+        return false;
+    }
+
+    // найти ключ в объекте, парсер встанет перед значением
+    bool find(const char* key) {
+        return find(key, strlen(key));
+    }
+
    private:
+    struct _Dec {
+        Parser& p;
+        const char* key;
+        uint16_t len;
+        uint8_t want;
+        bool pos, found, ok;
+
+        template <typename V>
+        void operator()(uint8_t i, const char* name, uint8_t nlen, V& v) {
+            if (found || (pos && i != want) || nlen != len || memcmp(name, key, len)) return;
+            found = true;
+            want = i + 1;
+            ok = p._decVal(v, 0);
+        }
+    };
+
+    template <typename V>
+    auto _decVal(V& v, int) -> decltype(v.bsonFields(*(_Dec*)nullptr), bool()) {
+        return decode(v);
+    }
+    template <typename V, size_t N>
+    bool _decVal(V (&arr)[N], int) {
+        if (!next('[')) return false;
+        for (size_t i = 0;; i++) {
+            if (_ovf()) return _abort(BSStats::Truncated);
+            if (*_cur == BS_ARR_CLOSE) return next();
+            if (i < N) {
+                if (!_decVal(arr[i], 0)) return false;
+            } else {
+                if (!next() || !skip()) return false;
+            }
+        }
+    }
+    template <size_t N>
+    bool _decVal(char (&str)[N], int) {
+        if (!next(BSType::String)) return false;
+        uint16_t len = _data < N - 1 ? _data : N - 1;
+        memcpy(str, _dataP(), len);
+        str[len] = 0;
+        return true;
+    }
+    bool _decVal(bool& v, int) {
+        return readBool(&v);
+    }
+    bool _decVal(float& v, int) {
+        double d;
+        return _decVal(d, 0) ? (v = d, true) : false;
+    }
+    bool _decVal(double& v, int) {
+        if (!next()) return false;
+        if (_type == BSType::Float) v = toDouble();
+        else if (_type == BSType::Integer) v = toInt64();
+        else return false;
+        return true;
+    }
+    template <typename V>
+    bool _decVal(V& v, long) {
+        if (!next()) return false;
+        if (_type == BSType::Integer) v = V(toInt64());
+        else if (_type == BSType::Code || _str) v = V(toCode<int>());
+        else if (_type == BSType::Boolean) v = V(toBool());
+        else return false;
+        return true;
+    }
+
     void* _dataP() const {
-        return _cur - _data;
+        return _str ? (void*)_str : (void*)(_cur - _data);
     }
-    bool _ovf(uint16_t len) const {
-        return _cur + len > _end;
+    bool _ovf(size_t len) const {
+        return len > size_t(_end - _cur);
     }
     bool _ovf() const {
         return _cur >= _end;
     }
+    // парсер начинает с пары внутри объекта
+    void _inObject() {
+        _objs = 1;
+        _key = true;
+    }
     bool _abort() {
         _type = BSType::Error;
         _cur = _end;
         return false;
     }
+    bool _abort(uint8_t cause) {
+        BS_STAT(_stats.errors[cause]++);
+        (void)cause;
+        return _abort();
+    }
 
     template <typename T>
     T _toInt() const {
@@ -664,7 +1664,119 @@ class BSON::Parser {
     }
 
     uint8_t *_bson, *_cur, *_end;
-    uint16_t _data;
+    uint8_t* _hdr = nullptr;  // заголовок последнего контейнера
+    const BSDictionary* _dict = nullptr;
+    const char* _str = nullptr;
+    uint32_t _data = 0;
+    uint32_t _count = 0;
+    uint8_t _head = 0;
+    uint16_t _code = 0;
+    uint64_t _objs = 0;  // стек объект/массив по уровням, глубже 64 уровней коды не раскрываются
+    bool _key = false;   // следующий блок - ключ
     bool _done = false;
     BSType _type = BSType::Error;
+#ifdef BSON_STATS
+    BSStats::Local _stats;
+#endif
 };
+
+
+// ============== DICTIONARY ==============
+inline bool BSDictionary::learn(uint8_t* bson, size_t len) {
+    BSON::Parser p(bson, len);
+    BSStack<uint8_t> stack;
+    bool obj = false, keyf = true;
+
+    while (p.next()) {
+        if (p.getType() == BSType::Container) {
+            if (p.isOpen()) {
+                stack.push(obj);
+                obj = p.isObject();
+            } else {
+                obj = stack.length() ? stack.pop() : false;
+            }
+            keyf = true;
+        } else if (obj) {
+            if (keyf && p.getType() == BSType::String) learn(p.toStr(), p.length());
+            keyf = !keyf;
+        }
+    }
+    return !len || p.isDone();
+}
+
+// ============== SORTED ==============
+inline bool BSON::_sort(uint32_t pos) {
+    struct Pair {
+        const char* key;
+        uint16_t klen;
+        uint32_t start, len;
+
+        static int cmp(const void* a, const void* b) {
+            const Pair& pa = *(const Pair*)a;
+            const Pair& pb = *(const Pair*)b;
+            int c = BSON::_keyCmp(pa.key, pa.klen, pb.key, pb.klen);
+            return c ? c : (pa.start < pb.start ? -1 : 1);
+        }
+    };
+
+    // пары разбираются тем же словарём, что и при сборке: порядок по строке ключа
+    uint32_t base = pos + BS_CONT_SIZE_LEN + BS_SOBJ_CNT_LEN;
+    Parser p(buf() + base, length() - base);
+    p.setDictionary(_dict);
+    p._inObject();
+    BSStack<Pair> pairs;
+    while (p._cur < p._end) {
+        uint8_t* s = p._cur;
+        if (!p.next()) return false;
+        Pair pr{(const char*)p._dataP(), uint16_t(p._data), uint32_t(s - buf() - base), 0};
+        if (p._type == BSType::Code) {
+            pr.key = (const char*)s;
+            pr.klen = 2;
+        } else if (p._type != BSType::String) {
+            return false;
+        }
+        if (!p.next() || p.isClose() || !p.skip()) return false;
+        pr.len = p._cur - s;
+        if (!pairs.push(pr)) return false;
+    }
+    if (!pairs.length()) return true;
+    if (pairs.length() > 0xffff) return false;
+
+    qsort(pairs.buf(), pairs.length(), sizeof(Pair), Pair::cmp);
+
+    size_t mlen = length() - base, tlen = pairs.length() * BS_SOBJ_OFFS_LEN;
+    BSStack<uint8_t> tmp;
+    if (!tmp.reserve(tlen + mlen)) return false;
+    uint32_t off = 0;
+    for (size_t i = 0; i < pairs.length(); i++) {
+        tmp.concat((const uint8_t*)&off, BS_SOBJ_OFFS_LEN);
+        off += pairs.buf()[i].len;
+    }
+    for (size_t i = 0; i < pairs.length(); i++) {
+        tmp.concat(buf() + base + pairs.buf()[i].start, pairs.buf()[i].len);
+    }
+
+    if (!_resize(base + tmp.length())) {
+        _resize(base + mlen);
+        return false;
+    }
+    uint16_t cnt = pairs.length();
+    memcpy(buf() + base - BS_SOBJ_CNT_LEN, &cnt, BS_SOBJ_CNT_LEN);
+    memcpy(buf() + base, tmp.buf(), tmp.length());
+    return true;
+}
+
+#include "BS_Compress.h"
+#include "BS_Counter.h"
+#include "BS_Editor.h"
+#include "BS_Fixed.h"
+#include "BS_Gather.h"
+#include "BS_Index.h"
+#include "BS_Json.h"
+#include "BS_Log.h"
+#include "BS_Patch.h"
+#include "BS_Pool.h"
+#include "BS_Query.h"
+#include "BS_Scanner.h"
+#include "BS_StreamParser.h"
+#include "BS_Writer.h"
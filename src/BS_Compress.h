@@ -0,0 +1,510 @@
+#pragma once
+#include "BSON.h"
+
+#ifndef __AVR__
+#include <functional>
+#endif
+
+// ============== COMPRESS ==============
+// сжатие пакетов блоками LZ: [длина - 1 (2 байта)][длина сжатого - 1 (2 байта)][данные], блок до 64 кБ.
+// Несжавшийся блок хранится как есть (длины равны). Блоки независимы: совпадения ищутся в самом блоке
+// и в префиксе из ключей словаря, записанных как строки BSON - ключи даже небольшого пакета сжимаются ссылками.
+// Последовательность: [литералы 4 бита | совпадение - 4 4 бита][+литералы][литералы][смещение 2 байта][+совпадение]
+
+#ifndef BS_LZ_HASH_BITS
+#ifdef __AVR__
+#define BS_LZ_HASH_BITS 6
+#else
+#define BS_LZ_HASH_BITS 12
+#endif
+#endif
+
+#ifndef BS_LZ_BLOCK
+#ifdef __AVR__
+#define BS_LZ_BLOCK 256u
+#else
+#define BS_LZ_BLOCK 65536u
+#endif
+#endif
+
+#define BS_LZ_MAX_BLOCK 65536u  // максимальный блок
+#define BS_LZ_MAX_PREFIX 32768u // максимальный префикс словаря
+#define BS_LZ_HEAD 4            // заголовок блока
+#define BS_LZ_MIN 4             // минимальное совпадение
+#define BS_LZ_LAST 5            // литералов в конце блока
+#define BS_LZ_LIMIT 12          // совпадение начинается не ближе к концу блока
+#define BS_LZ_SLACK 32          // запас буфера распаковки для копирования словами
+
+struct BSON::_Lz {
+    // префикс: ключи словаря как строки BSON
+    static bool prefix(const BSDictionary* dict, BSStack<uint8_t>& pre) {
+        pre.clear();
+        if (!dict) return true;
+        for (uint16_t i = 0; i < dict->length(); i++) {
+            const char* key = dict->get(i);
+            size_t len = strlen(key);
+            if (pre.length() + 2 + len > BS_LZ_MAX_PREFIX) break;
+            if (!pre.push(BS_STRING | BS_D16_MSB(len)) || !pre.push(BS_D16_LSB(len)) || !pre.concat((const uint8_t*)key, len)) return false;
+        }
+        return true;
+    }
+
+    // наибольший размер сжатого блока
+    static size_t bound(size_t len) {
+        return BS_LZ_HEAD + len + len / 255 + 16;
+    }
+
+    static uint32_t read32(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    // продолжение длины: байты 255 и последний < 255
+    static bool len(const uint8_t*& ip, const uint8_t* iend, size_t& n) {
+        uint8_t b;
+        do {
+            if (ip >= iend) return false;
+            b = *ip++;
+            n += b;
+        } while (b == 255);
+        return true;
+    }
+
+    // копирование по 16 байт, может записать до 15 байт за dst + n
+    static void wild(uint8_t* dst, const uint8_t* src, size_t n) {
+        uint8_t* end = dst + n;
+        do {
+            memcpy(dst, src, 16);
+            dst += 16;
+            src += 16;
+        } while (dst < end);
+    }
+
+    // распаковать блок в dst (rlen байт, буфер cap >= rlen байт). pre - префикс словаря
+    static bool decode(const uint8_t* ip, size_t slen, uint8_t* dst, size_t rlen, size_t cap, const uint8_t* pre, size_t plen) {
+        const uint8_t* iend = ip + slen;
+        uint8_t* op = dst;
+        uint8_t* oend = dst + rlen;
+        uint8_t* ocap = dst + cap;
+
+        while (ip < iend) {
+            uint8_t token = *ip++;
+            size_t lit = token >> 4;
+            if (lit == 15 && !len(ip, iend, lit)) return false;
+            if (lit > size_t(iend - ip) || lit > size_t(oend - op)) return false;
+            if (size_t(ocap - op) >= lit + 16 && size_t(iend - ip) >= lit + 16) wild(op, ip, lit);
+            else memcpy(op, ip, lit);
+            op += lit;
+            ip += lit;
+            if (ip == iend) return op == oend;  // последние литералы
+
+            if (iend - ip < 2) return false;
+            size_t off = ip[0] | (ip[1] << 8);
+            ip += 2;
+            size_t ml = token & 15;
+            if (ml == 15 && !len(ip, iend, ml)) return false;
+            ml += BS_LZ_MIN;
+            if (!off || ml > size_t(oend - op)) return false;
+
+            if (off > size_t(op - dst)) {  // начало совпадения в префиксе
+                size_t back = off - (op - dst);
+                if (back > plen) return false;
+                size_t n = back < ml ? back : ml;
+                memcpy(op, pre + plen - back, n);
+                op += n;
+                ml -= n;
+                if (!ml) continue;
+            }
+
+            const uint8_t* m = op - off;
+            if (off >= 16 && size_t(ocap - op) >= ml + 16) {
+                wild(op, m, ml);
+                op += ml;
+            } else if (off >= 8 && size_t(ocap - op) >= ml + 8) {
+                uint8_t* end = op + ml;
+                for (uint8_t* d = op; d < end; d += 8, m += 8) memcpy(d, m, 8);
+                op = end;
+            } else {
+                while (ml--) *op++ = *m++;
+            }
+        }
+        return false;
+    }
+};
+
+// сжатие целиком в BSON или потоком: данные частями в write(), готовые блоки уходят в обработчик
+class BSON::Compressor {
+   public:
+#ifdef __AVR__
+    typedef void (*Callback)(const uint8_t* data, size_t len);
+#else
+    typedef std::function<void(const uint8_t* data, size_t len)> Callback;
+#endif
+
+    Compressor() {}
+    Compressor(Callback cb) : _cb(cb) {}
+
+    // подключить обработчик сжатых блоков
+    void attach(Callback cb) {
+        _cb = cb;
+    }
+
+    // словарь ключей для префикса, при распаковке нужен тот же. nullptr - отключить. Менять между потоками
+    bool setDictionary(const BSDictionary* dict) {
+        if (!_Lz::prefix(dict, _pre)) return false;
+        _win.clear();
+        return _win.concat(_pre.buf(), _pre.length());
+    }
+
+    // размер блока потока, до 64 кБ (по умолчанию BS_LZ_BLOCK). Блоки крупнее - сжатие лучше, буферы больше. Менять между потоками
+    void setBlock(size_t size) {
+        _block = (size && size <= BS_LZ_MAX_BLOCK) ? size : BS_LZ_MAX_BLOCK;
+    }
+
+    // сжать данные и дописать в out. Вернёт false при ошибке выделения памяти или если в потоке есть данные
+    bool compress(const uint8_t* data, size_t len, BSON& out) {
+        if (!_init() || _win.length() != _pre.length()) return false;
+        while (len) {
+            size_t n = len < BS_LZ_MAX_BLOCK ? len : BS_LZ_MAX_BLOCK;
+            size_t pos = out.length();
+            if (!out._resize(pos + _Lz::bound(n))) {
+                out._resize(pos);
+                return false;
+            }
+
+            size_t clen;
+            if (_pre.length()) {  // префикс и данные подряд
+                _win.clear();
+                if (!_win.concat(_pre.buf(), _pre.length()) || !_win.concat(data, n)) return false;
+                clen = _emit(_win.buf(), _pre.length(), _win.length(), out.buf() + pos);
+            } else {
+                clen = _emit(data, 0, n, out.buf() + pos);
+            }
+            out._resize(pos + clen);
+            data += n;
+            len -= n;
+        }
+        _win.clear();
+        return _win.concat(_pre.buf(), _pre.length());
+    }
+
+    // сжать пакет и дописать в out
+    bool compress(BSON& bson, BSON& out) {
+        return compress(bson.buf(), bson.length(), out);
+    }
+
+    // добавить данные в поток. Заполненный блок сжимается и отправляется в обработчик
+    bool write(const void* data, size_t len) {
+        const uint8_t* p = (const uint8_t*)data;
+        while (len) {
+            size_t used = _win.length() - _pre.length();
+            if (used >= _block) {
+                if (!flush()) return false;
+                continue;
+            }
+            size_t n = _block - used;
+            if (n > len) n = len;
+            if (!_win.concat(p, n)) return false;
+            p += n;
+            len -= n;
+            if (_win.length() == _pre.length() + _block && !flush()) return false;
+        }
+        return true;
+    }
+
+    // сжать и отправить неполный блок. Вызвать в конце потока
+    bool flush() {
+        size_t n = _win.length() - _pre.length();
+        if (!n) return true;
+        if (!_init()) return false;
+        while (_out.length() < _Lz::bound(n)) {
+            if (!_out.push(0)) return false;
+        }
+        size_t clen = _emit(_win.buf(), _pre.length(), _win.length(), _out.buf());
+        if (_cb) _cb(_out.buf(), clen);
+        _sent += clen;
+
+        _win.clear();
+        return _win.concat(_pre.buf(), _pre.length());
+    }
+
+    // отправлено сжатых байт
+    size_t sent() const {
+        return _sent;
+    }
+
+   private:
+    BSStack<uint32_t> _hash;  // позиции + _gen
+    BSStack<uint8_t> _pre;    // префикс словаря
+    BSStack<uint8_t> _win;    // префикс и данные блока
+    BSStack<uint8_t> _out;    // сжатый блок потока
+    Callback _cb = nullptr;
+    size_t _block = BS_LZ_BLOCK;
+    size_t _sent = 0;
+    uint32_t _gen = 1;  // позиции прошлых блоков в таблице меньше _gen
+
+    bool _init() {
+        while (_hash.length() < (1ul << BS_LZ_HASH_BITS)) {
+            if (!_hash.push(0)) return false;
+        }
+        return true;
+    }
+
+    static uint32_t _h(const uint8_t* p) {
+        return uint32_t(_Lz::read32(p) * 2654435761ul) >> (32 - BS_LZ_HASH_BITS);
+    }
+
+    // длина совпадения p и m до limit
+    static size_t _count(const uint8_t* p, const uint8_t* m, const uint8_t* limit) {
+        const uint8_t* s = p;
+#if defined(__GNUC__) && !defined(__AVR__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        while (limit - p >= 8) {
+            uint64_t a, b;
+            memcpy(&a, p, 8);
+            memcpy(&b, m, 8);
+            if (a != b) return (p - s) + (__builtin_ctzll(a ^ b) >> 3);
+            p += 8;
+            m += 8;
+        }
+#endif
+        while (p < limit && *p == *m) {
+            p++;
+            m++;
+        }
+        return p - s;
+    }
+
+    static uint8_t* _len(uint8_t* op, size_t n) {
+        for (; n >= 255; n -= 255) *op++ = 255;
+        *op++ = n;
+        return op;
+    }
+
+    // последовательность: литералы и совпадение (mlen = 0 - только литералы)
+    static uint8_t* _seq(uint8_t* op, const uint8_t* lit, size_t llen, size_t off, size_t mlen) {
+        uint8_t* token = op++;
+        *token = (llen >= 15 ? 15 : llen) << 4;
+        if (llen >= 15) op = _len(op, llen - 15);
+        memcpy(op, lit, llen);
+        op += llen;
+        if (!mlen) return op;
+
+        *op++ = off;
+        *op++ = off >> 8;
+        mlen -= BS_LZ_MIN;
+        *token |= mlen >= 15 ? 15 : mlen;
+        if (mlen >= 15) op = _len(op, mlen - 15);
+        return op;
+    }
+
+    // сжать base[start, end) в dst с заголовком, совпадения ищутся с base. Вернёт длину
+    size_t _emit(const uint8_t* base, size_t start, size_t end, uint8_t* dst) {
+        if (_gen > 0xfff00000ul) {  // позиции не должны переполниться
+            memset(_hash.buf(), 0, _hash.length() * sizeof(uint32_t));
+            _gen = 1;
+        }
+        uint32_t* tab = _hash.buf();
+        uint32_t gen = _gen;
+        _gen += end + 1;
+
+        const uint8_t* ip = base;
+        const uint8_t* iend = base + end;
+        for (; ip + BS_LZ_MIN <= base + start; ip++) tab[_h(ip)] = gen + (ip - base);
+
+        const uint8_t* anchor = ip = base + start;
+        uint8_t* op = dst + BS_LZ_HEAD;
+        if (end - start >= BS_LZ_LIMIT) {
+            const uint8_t* mlimit = iend - BS_LZ_LIMIT;
+            const uint8_t* mend = iend - BS_LZ_LAST;
+            uint32_t step = 1 << 6;  // шаг растёт на несжимаемых данных
+            while (ip <= mlimit) {
+                uint32_t h = _h(ip);
+                uint32_t c = tab[h];
+                tab[h] = gen + (ip - base);
+                const uint8_t* m = base + (c - gen);
+                if (c < gen || ip - m > 0xffff || _Lz::read32(m) != _Lz::read32(ip)) {
+                    ip += step++ >> 6;
+                    continue;
+                }
+                step = 1 << 6;
+                while (ip > anchor && m > base && ip[-1] == m[-1]) {
+                    ip--;
+                    m--;
+                }
+                const uint8_t* e = ip + BS_LZ_MIN;
+                e += _count(e, m + BS_LZ_MIN, mend);
+                op = _seq(op, anchor, ip - anchor, ip - m, e - ip);
+                anchor = ip = e;
+                tab[_h(ip - 2)] = gen + (ip - 2 - base);
+            }
+        }
+        op = _seq(op, anchor, iend - anchor, 0, 0);
+
+        uint16_t rlen = end - start - 1;
+        size_t clen = op - dst - BS_LZ_HEAD;
+        if (clen >= size_t(end - start)) {  // не сжалось
+            memcpy(dst + BS_LZ_HEAD, base + start, end - start);
+            clen = end - start;
+        }
+        uint16_t c16 = clen - 1;
+        memcpy(dst, &rlen, 2);
+        memcpy(dst + 2, &c16, 2);
+        return BS_LZ_HEAD + clen;
+    }
+};
+
+// распаковка целиком в BSON или потоком: сжатые данные частями в feed(), распакованные блоки уходят в обработчик
+class BSON::Decompressor {
+   public:
+#ifdef __AVR__
+    typedef void (*Callback)(const uint8_t* data, size_t len);
+#else
+    typedef std::function<void(const uint8_t* data, size_t len)> Callback;
+#endif
+
+    Decompressor() {}
+    Decompressor(Callback cb) : _cb(cb) {}
+
+    // подключить обработчик распакованных данных
+    void attach(Callback cb) {
+        _cb = cb;
+    }
+
+    // словарь ключей, как при сжатии. Вернёт false при ошибке выделения памяти
+    bool setDictionary(const BSDictionary* dict) {
+        return _Lz::prefix(dict, _pre);
+    }
+
+    // распаковать данные и дописать в out. Вернёт false при ошибке в данных
+    bool decompress(const uint8_t* data, size_t len, BSON& out) {
+        size_t total = 0;
+        for (size_t i = 0; i < len;) {  // размер заранее, одно выделение памяти
+            uint16_t rlen, clen;
+            if (!_head(data + i, len - i, rlen, clen)) return false;
+            total += rlen + 1;
+            i += BS_LZ_HEAD + clen + 1;
+        }
+
+        size_t pos = out.length();
+        if (!out._resize(pos + total + BS_LZ_SLACK)) {
+            out._resize(pos);
+            return false;
+        }
+        uint8_t* dst = out.buf() + pos;
+        uint8_t* end = dst + total + BS_LZ_SLACK;
+        for (size_t i = 0; i < len;) {
+            uint16_t rlen = 0, clen = 0;
+            _head(data + i, len - i, rlen, clen);
+            if (!_block(data + i + BS_LZ_HEAD, clen + 1, dst, rlen + 1, end - dst)) {
+                out._resize(pos);
+                return false;
+            }
+            dst += rlen + 1;
+            i += BS_LZ_HEAD + clen + 1;
+        }
+        out._resize(pos + total);
+        return true;
+    }
+
+    // распаковать данные и дописать в out
+    bool decompress(BSON& data, BSON& out) {
+        return decompress(data.buf(), data.length(), out);
+    }
+
+    // передать часть сжатого потока. Вернёт false при ошибке в данных
+    bool feed(const uint8_t* data, size_t len) {
+        if (_err) return false;
+        while (len) {
+            size_t n;
+            if (_in.length() < BS_LZ_HEAD) {
+                n = BS_LZ_HEAD - _in.length();
+            } else {
+                uint16_t rlen, clen;
+                memcpy(&rlen, _in.buf(), 2);
+                memcpy(&clen, _in.buf() + 2, 2);
+                if (clen > rlen) return _abort();
+                n = BS_LZ_HEAD + clen + 1 - _in.length();
+                if (_in.length() == BS_LZ_HEAD && len >= n) {  // блок целиком во входных данных
+                    if (!_emit(data, n, rlen + 1)) return _abort();
+                    data += n;
+                    len -= n;
+                    _in.clear();
+                    continue;
+                }
+            }
+            if (n > len) n = len;
+            if (!_in.concat(data, n)) return _abort();
+            data += n;
+            len -= n;
+
+            if (_in.length() > BS_LZ_HEAD) {
+                uint16_t rlen, clen;
+                memcpy(&rlen, _in.buf(), 2);
+                memcpy(&clen, _in.buf() + 2, 2);
+                if (_in.length() == BS_LZ_HEAD + clen + 1u) {
+                    if (!_emit(_in.buf() + BS_LZ_HEAD, clen + 1, rlen + 1)) return _abort();
+                    _in.clear();
+                }
+            }
+        }
+        return true;
+    }
+
+    // поток принят полностью (нет недополученного блока)
+    bool isDone() const {
+        return !_err && !_in.length();
+    }
+
+    // начать заново
+    void reset() {
+        _in.clear();
+        _err = false;
+    }
+
+   private:
+    BSStack<uint8_t> _pre;  // префикс словаря
+    BSStack<uint8_t> _in;   // недополученный блок
+    BSStack<uint8_t> _out;  // распакованный блок
+    Callback _cb = nullptr;
+    bool _err = false;
+
+    static bool _head(const uint8_t* p, size_t len, uint16_t& rlen, uint16_t& clen) {
+        if (len < BS_LZ_HEAD) return false;
+        memcpy(&rlen, p, 2);
+        memcpy(&clen, p + 2, 2);
+        return clen <= rlen && clen + 1u <= len - BS_LZ_HEAD;
+    }
+
+    bool _block(const uint8_t* src, size_t clen, uint8_t* dst, size_t rlen, size_t cap) {
+        if (clen == rlen) {
+            memcpy(dst, src, rlen);
+            return true;
+        }
+        return _Lz::decode(src, clen, dst, rlen, cap, _pre.buf(), _pre.length());
+    }
+
+    bool _emit(const uint8_t* src, size_t clen, size_t rlen) {
+        while (_out.length() < rlen + BS_LZ_SLACK) {
+            if (!_out.push(0)) return false;
+        }
+        if (!_block(src, clen, _out.buf(), rlen, _out.length())) return false;
+        if (_cb) _cb(_out.buf(), rlen);
+        return true;
+    }
+
+    bool _abort() {
+        _err = true;
+        return false;
+    }
+};
+
+inline bool BSON::compress(const uint8_t* bson, size_t len, BSON& out, const BSDictionary* dict) {
+    Compressor c;
+    return c.setDictionary(dict) && c.compress(bson, len, out);
+}
+
+inline bool BSON::decompress(const uint8_t* data, size_t len, BSON& out, const BSDictionary* dict) {
+    Decompressor d;
+    return d.setDictionary(dict) && d.decompress(data, len, out);
+}
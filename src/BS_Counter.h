@@ -0,0 +1,116 @@
+#pragma once
+#include "BSON.h"
+
+// ============== COUNTER ==============
+// сборщик, который только считает размер пакета. Тот же код сборки можно выполнить дважды:
+// сначала в Counter, затем в BSON с reserve() на точный размер
+class BSON::Counter : public BSBuilder<BSON::Counter> {
+    typedef BSBuilder<BSON::Counter> BD;
+    friend class BSBuilder<BSON::Counter>;
+
+   public:
+    using BD::operator=;
+
+    void push(uint8_t) {
+        _len++;
+    }
+
+    size_t write(const void*, size_t len, bool = false) {
+        _len += len;
+        return len;
+    }
+
+    // размер пакета
+    size_t length() const {
+        return _len;
+    }
+
+    // начать заново
+    void clear() {
+        _len = 0;
+        _keys.clear();
+    }
+
+    // как BSON::setSized() у целевого сборщика
+    void setSized(bool sized) {
+        _sized = sized;
+    }
+
+    // как BSON::setSorted() у целевого сборщика
+    void setSorted(bool sorted) {
+        _sorted = sorted;
+    }
+
+   private:
+    static const uint32_t _NO_KEYS = 0xffffffff;
+
+    size_t _len = 0;
+    BSStack<uint32_t> _keys;  // ключей в открытых отсортированных объектах, _NO_KEYS - другой контейнер
+    bool _sized = false;
+    bool _sorted = false;
+
+    void _open(uint8_t cont) {
+        bool sorted = _sorted && cont == BS_OBJ_OPEN;
+        _len += 1;
+        if (_sized || sorted) _len += BS_CONT_SIZE_LEN;
+        if (sorted) _len += BS_SOBJ_CNT_LEN;
+        if (_sorted) _keys.push(sorted ? 0 : _NO_KEYS);
+    }
+
+    void _close(uint8_t) {
+        if (_sorted && _keys.length()) {
+            uint32_t n = _keys.pop();
+            if (n != _NO_KEYS) {  // таблица смещений или обычный объект, как BSON::_sort
+                if (n <= 0xffff) _len += n * BS_SOBJ_OFFS_LEN;
+                else _len -= BS_SOBJ_CNT_LEN;
+            }
+        }
+        _len += 1;
+    }
+
+    void _keyed() {
+        if (_keys.length() && _keys.buf()[_keys.length() - 1] != _NO_KEYS) _keys.buf()[_keys.length() - 1]++;
+    }
+};
+
+// ============== SIZE OF ==============
+template <typename T>
+size_t BSON::sizeOf(const T& val) {
+    Counter c;
+    c.add(val);
+    return c.length();
+}
+
+inline size_t BSON::sizeOf(float val) {
+    Counter c;
+    c = val;
+    return c.length();
+}
+
+inline size_t BSON::sizeOf(double val) {
+    Counter c;
+    c = val;
+    return c.length();
+}
+
+inline size_t BSON::sizeOf(double val, int dec) {
+    Counter c;
+    c.add(val, dec);
+    return c.length();
+}
+
+inline size_t BSON::sizeOf(const char* str, size_t len) {
+    Counter c;
+    c.addStr(str, len);
+    return c.length();
+}
+
+inline size_t BSON::sizeOfBin(size_t len) {
+    return (len > BS_MAX_LEN) ? 1 + BS_EXT_LEN + len : 2 + len;
+}
+
+template <typename T>
+size_t BSON::sizeOfArray(size_t len) {
+    static_assert(BS_TA_VALID(T), "sizeOfArray: integers of 1, 2, 4, 8 bytes, float or double");
+    return 2 + (len > 0xffff ? 4 : (len > 0xff ? 2 : 1)) + len * sizeof(T);
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BS_MACRO.h"
+
+// ============== DICTIONARY ==============
+// словарь ключей: строка <-> код BS_CODE. Сборщик заменяет ключи из словаря на коды,
+// парсер и stringify разворачивают коды обратно в строки
+class BSDictionary {
+   public:
+    BSDictionary() {}
+
+    // из массива строк, код - индекс в массиве. Массив должен существовать, пока используется словарь
+    BSDictionary(const char* const* keys, uint16_t len) : _keys(keys) {
+        if (len > BS_MAX_LEN + 1) len = BS_MAX_LEN + 1;
+        _len = len;
+        _rehash();
+    }
+
+    template <size_t N>
+    BSDictionary(const char* const (&keys)[N]) : BSDictionary(keys, N) {}
+
+    // код строки или -1
+    int find(const char* str, size_t len) const {
+        if (!_tab.length()) return -1;
+        uint16_t mask = _tab.length() - 1;
+        for (uint16_t i = hash(str, len) & mask;; i = (i + 1) & mask) {
+            uint16_t c = _tab.buf()[i];
+            if (!c) return -1;
+            const char* k = get(c - 1);
+            if (!strncmp(k, str, len) && !k[len]) return c - 1;
+        }
+    }
+
+    // код строки или -1
+    int find(const char* str) const {
+        return find(str, strlen(str));
+    }
+
+    // строка по коду или nullptr
+    const char* get(uint16_t code) const {
+        if (code >= _len) return nullptr;
+        return _keys ? _keys[code] : _pool.buf() + _offs.buf()[code];
+    }
+
+    // количество строк
+    uint16_t length() const {
+        return _len;
+    }
+
+    // добавить строку, вернёт код или -1 [кроме словаря из массива]
+    int add(const char* str, size_t len) {
+        int c = find(str, len);
+        if (c >= 0) return c;
+        if (_keys || _len > BS_MAX_LEN) return -1;
+
+        if (!_offs.push(_pool.length())) return -1;
+        for (size_t i = 0; i < len; i++) _pool.push(str[i]);
+        if (!_pool.push(0) || !_cnt.push(0)) return -1;
+        _len++;
+
+        if (_len * 2 > _tab.length()) _rehash();
+        else _insert(_len - 1);
+        return _len - 1;
+    }
+
+    // ============== learn ==============
+
+    // учесть ключ при обучении
+    void learn(const char* str, size_t len) {
+        int c = add(str, len);
+        if (c >= 0) _cnt.buf()[c]++;
+    }
+
+    // учесть все ключи объектов в пакете. Вернёт false при ошибке в пакете
+    bool learn(uint8_t* bson, size_t len);
+
+    // закончить обучение: оставить limit самых выгодных ключей (частота * длина)
+    void finish(uint16_t limit = BS_MAX_LEN + 1) {
+        if (_keys) return;
+
+        struct Score {
+            uint32_t score;
+            uint16_t code;
+        };
+        BSStack<Score> scores;
+        for (uint16_t i = 0; i < _len; i++) {
+            scores.push(Score{uint32_t(_cnt.buf()[i] * strlen(get(i))), i});
+        }
+        qsort(scores.buf(), scores.length(), sizeof(Score), [](const void* a, const void* b) -> int {
+            const Score& sa = *(const Score*)a;
+            const Score& sb = *(const Score*)b;
+            if (sa.score != sb.score) return sa.score < sb.score ? 1 : -1;
+            return sa.code < sb.code ? -1 : 1;
+        });
+
+        BSDictionary d;
+        for (uint16_t i = 0; i < scores.length() && i < limit; i++) {
+            const char* k = get(scores.buf()[i].code);
+            d.add(k, strlen(k));
+        }
+        _pool.clear();
+        _offs.clear();
+        _cnt.clear();
+        _tab.clear();
+        _len = 0;
+        for (uint16_t i = 0; i < d._len; i++) {
+            const char* k = d.get(i);
+            add(k, strlen(k));
+        }
+    }
+
+    // очистить
+    void clear() {
+        _keys = nullptr;
+        _pool.clear();
+        _offs.clear();
+        _cnt.clear();
+        _tab.clear();
+        _len = 0;
+    }
+
+    // FNV-1a
+    static uint32_t hash(const char* str, size_t len) {
+        uint32_t h = 2166136261ul;
+        while (len--) {
+            h ^= uint8_t(*str++);
+            h *= 16777619ul;
+        }
+        return h;
+    }
+
+   private:
+    const char* const* _keys = nullptr;
+    mutable BSStack<char> _pool;
+    mutable BSStack<uint32_t> _offs;
+    BSStack<uint32_t> _cnt;
+    mutable BSStack<uint16_t> _tab;  // код + 1, 0 - пусто
+    uint16_t _len = 0;
+
+    void _rehash() {
+        uint16_t size = 16;
+        while (size < _len * 2) size <<= 1;
+        _tab.clear();
+        if (!_tab.reserve(size)) return;
+        while (_tab.length() < size) _tab.push(0);
+        for (uint16_t i = 0; i < _len; i++) _insert(i);
+    }
+
+    void _insert(uint16_t code) {
+        const char* k = get(code);
+        uint16_t mask = _tab.length() - 1;
+        uint16_t i = hash(k, strlen(k)) & mask;
+        while (_tab.buf()[i]) i = (i + 1) & mask;
+        _tab.buf()[i] = code + 1;
+    }
+};
@@ -0,0 +1,212 @@
+#pragma once
+#include "BSON.h"
+
+// ============== EDITOR ==============
+// изменение значений в готовом пакете без пересборки. Путь - ключи и индексы через точку: "net.ports.3",
+// точка и обратная черта в ключе экранируются обратной чертой: "a\\.b" - ключ "a.b".
+// Значение того же размера пишется на место, иначе хвост пакета сдвигается одним memmove,
+// размеры родительских контейнеров с размером и смещения отсортированных объектов исправляются.
+// В отсортированный объект нельзя добавить ключ и из него нельзя удалить ключ
+class BSON::Editor {
+    friend struct BSON::_Patch;
+
+   public:
+    Editor(BSON& bson) : _b(bson) {}
+
+    // словарь для ключей-кодов в пакете
+    void setDictionary(const BSDictionary* dict) {
+        _dict = dict;
+        _tmp.setDictionary(dict);
+    }
+
+    // значение существует
+    bool has(const char* path) {
+        _Loc l;
+        return _find(path, l) && l.found;
+    }
+
+    // заменить значение, аргументы как у add(). Вернёт false, если путь не найден
+    template <typename... Args>
+    bool set(const char* path, Args... args) {
+        _tmp.clear();
+        _tmp.add(args...);
+        return _put(path, 0, false);
+    }
+
+    // заменить значение на null
+    bool setNull(const char* path) {
+        _tmp.clear();
+        _tmp.addNull();
+        return _put(path, 0, false);
+    }
+
+    // заменить значение или добавить ключ в конец неотсортированного объекта, аргументы как у add()
+    template <typename... Args>
+    bool add(const char* path, Args... args) {
+        _tmp.clear();
+        _key(path);
+        size_t klen = _tmp.length();
+        _tmp.add(args...);
+        return _put(path, klen, true);
+    }
+
+    // удалить ключ со значением или элемент массива
+    bool remove(const char* path) {
+        _Loc l;
+        if (!*path || !_find(path, l) || !l.found || l.sorted) return false;
+        return _splice(l.key, l.end, nullptr, 0);
+    }
+
+   private:
+    // ключ (элемент массива), значение, конец значения. Не найден - позиция закрытия объекта
+    struct _Loc {
+        uint32_t key, pos, end;
+        bool found, sorted;  // sorted - родитель отсортирован
+    };
+
+    BSON& _b;
+    BSON _tmp;
+    BSStack<uint32_t> _anc;  // позиции заголовков родительских контейнеров
+    const BSDictionary* _dict = nullptr;
+
+    // конец ключа пути: неэкранированная точка или конец строки
+    static const char* _end(const char* path) {
+        while (*path && *path != '.') path += (*path == '\\' && path[1]) ? 2 : 1;
+        return path;
+    }
+
+    // ключ пакета равен ключу пути [key, end) с экранированием
+    static bool _keyEq(const char* str, size_t len, const char* key, const char* end) {
+        while (key < end) {
+            if (*key == '\\' && key + 1 < end) key++;
+            if (!len-- || *str++ != *key++) return false;
+        }
+        return !len;
+    }
+
+    // последний ключ пути в _tmp
+    void _key(const char* path) {
+        const char* key = path;
+        for (const char* e = _end(path); *e; e = _end(key)) key = e + 1;
+        if (!strchr(key, '\\')) {
+            _tmp[key];
+            return;
+        }
+        BSStack<char> str;
+        for (; *key; key++) {
+            if (*key == '\\' && key[1]) key++;
+            str.push(*key);
+        }
+        _tmp._key(str.buf(), str.length());
+    }
+
+    // в _tmp ключ длиной klen и значение
+    bool _put(const char* path, size_t klen, bool insert) {
+        _Loc l;
+        if (!_find(path, l)) return false;
+        if (l.found) return _splice(l.pos, l.end, _tmp.buf() + klen, _tmp.length() - klen);
+        return (insert && !l.sorted) ? _splice(l.pos, l.end, _tmp.buf(), _tmp.length()) : false;
+    }
+
+    // заменить байты [pos, end) на data
+    bool _splice(uint32_t pos, uint32_t end, const uint8_t* data, size_t nlen) {
+        size_t len = _b.length();
+        size_t olen = end - pos;
+        if (nlen > olen) {
+            if (!_b._resize(len + nlen - olen)) {  // не хватило памяти, убрать дописанное
+                _b._resize(len);
+                return false;
+            }
+            memmove(_b.buf() + pos + nlen, _b.buf() + end, len - end);
+        } else if (nlen < olen) {
+            memmove(_b.buf() + pos + nlen, _b.buf() + end, len - end);
+            _b._resize(len - olen + nlen);
+        }
+        if (nlen) memcpy(_b.buf() + pos, data, nlen);
+
+        if (nlen != olen) {
+            for (size_t i = 0; i < _anc.length(); i++) {
+                uint8_t* h = _b.buf() + _anc.buf()[i];
+                uint32_t size;
+                memcpy(&size, h + 1, BS_CONT_SIZE_LEN);
+                size = size + nlen - olen;
+                memcpy(h + 1, &size, BS_CONT_SIZE_LEN);
+                if (*h != BS_SOBJ_OPEN) continue;
+
+                // сдвинуть смещения пар после изменённой
+                uint16_t cnt;
+                uint8_t* offs = h + 1 + BS_CONT_SIZE_LEN + BS_SOBJ_CNT_LEN;
+                memcpy(&cnt, offs - BS_SOBJ_CNT_LEN, BS_SOBJ_CNT_LEN);
+                uint32_t base = offs + cnt * BS_SOBJ_OFFS_LEN - _b.buf();
+                for (uint16_t j = 0; j < cnt; j++) {
+                    uint32_t off;
+                    memcpy(&off, offs + j * BS_SOBJ_OFFS_LEN, BS_SOBJ_OFFS_LEN);
+                    if (base + off <= pos) continue;
+                    off = off + nlen - olen;
+                    memcpy(offs + j * BS_SOBJ_OFFS_LEN, &off, BS_SOBJ_OFFS_LEN);
+                }
+            }
+        }
+        return true;
+    }
+
+    // false - ошибка пути. Последний ключ может отсутствовать в объекте (l.found = false)
+    bool _find(const char* path, _Loc& l) {
+        uint8_t* buf = _b.buf();
+        Parser p(buf, _b.length());
+        p.setDictionary(_dict);
+        _anc.clear();
+        l.key = l.pos = 0;
+        l.found = true;
+        l.sorted = false;
+        if (!p.next()) return false;
+
+        while (*path) {
+            if (!p.isOpen()) return false;
+            if (p._data & BS_CONT_SIZED) _anc.push(p._hdr - buf);
+            l.sorted = p.isSorted();
+
+            const char* key = path;
+            path = _end(path);
+            const char* kend = path;
+            if (*path) path++;
+
+            bool obj = p.isObject();
+            uint32_t idx = 0;
+            if (!obj) {
+                for (const char* i = key; i < kend; i++) {
+                    if (*i < '0' || *i > '9') return false;
+                    idx = idx * 10 + *i - '0';
+                }
+            }
+
+            for (uint32_t i = 0;; i++) {
+                l.key = p._cur - buf;
+                if (!p.next()) return false;
+                if (p.isClose()) {
+                    if (!obj || *path) return false;
+                    l.pos = l.end = l.key;
+                    l.found = false;
+                    return true;
+                }
+
+                bool match;
+                if (obj) {
+                    if (p._type == BSType::Container) return false;
+                    match = p._type == BSType::String && _keyEq(p.toStr(), p._data, key, kend);  // код без словаря не совпадает
+                    l.pos = p._cur - buf;
+                    if (!p.next()) return false;
+                } else {
+                    match = i == idx;
+                    l.pos = l.key;
+                }
+                if (match) break;
+                if (!p.skip()) return false;
+            }
+        }
+
+        if (p.isOpen() && !p.skip()) return false;
+        l.end = p._cur - buf;
+        return true;
+    }
+};
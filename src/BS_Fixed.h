@@ -0,0 +1,109 @@
+#pragma once
+#include "BSON.h"
+
+// ============== FIXED ==============
+// сборка BSON в готовый буфер без выделения памяти. При нехватке места блок не пишется,
+// выставляется флаг overflowed(), размер продолжает считаться
+class BSON::Fixed : public BSBuilder<BSON::Fixed> {
+    typedef BSBuilder<BSON::Fixed> BD;
+    friend class BSBuilder<BSON::Fixed>;
+
+   public:
+    using BD::operator=;
+
+    // буфер buf размером cap
+    Fixed(uint8_t* buf, size_t cap) : _buf(buf), _cap(cap) {}
+
+    // записать байт
+    void push(uint8_t v) {
+        if (_len + _need < _cap) _buf[_len++] = v;
+        else _need++;
+    }
+
+    // записать данные. Не поместившиеся данные не пишутся
+    size_t write(const void* data, size_t len, bool pgm = false) {
+        if (_need || len > _cap - _len) {
+            _need += len;
+            return 0;
+        }
+#ifdef ARDUINO
+        if (pgm) memcpy_P(_buf + _len, data, len);
+        else
+#else
+        (void)pgm;
+#endif
+            memcpy(_buf + _len, data, len);
+        _len += len;
+        return len;
+    }
+
+    // начать новый пакет
+    void clear() {
+        _len = _need = 0;
+        _last = 0;
+        _lost = 0;
+    }
+
+    // контейнеры с размером, как BSON::setSized(). Менять между пакетами
+    void setSized(bool sized) {
+        _sized = sized;
+    }
+
+    // буфер
+    uint8_t* buf() {
+        return _buf;
+    }
+    operator uint8_t*() {
+        return _buf;
+    }
+
+    // записано байт
+    size_t length() const {
+        return _len;
+    }
+
+    // размер буфера
+    size_t capacity() const {
+        return _cap;
+    }
+
+    // не хватило места, пакет неполный
+    bool overflowed() const {
+        return _need;
+    }
+
+    // сколько байт не хватило до полного пакета
+    size_t needed() const {
+        return _need;
+    }
+
+   private:
+    uint8_t* _buf;
+    size_t _cap;
+    size_t _len = 0;
+    size_t _need = 0;
+    uint32_t _last = 0;  // конец поля размера открытого контейнера, в самом поле до закрытия - _last внешнего
+    uint16_t _lost = 0;  // открыто контейнеров после переполнения, их размер не пишется
+    bool _sized = false;
+
+    void _open(uint8_t cont) {
+        if (!_sized) return push(cont);
+        push(cont | BS_CONT_SIZED);
+        if (write(&_last, BS_CONT_SIZE_LEN)) _last = _len;
+        else _lost++;
+    }
+
+    void _close(uint8_t cont) {
+        if (_sized) {
+            if (_lost) {
+                _lost--;
+            } else if (_last) {
+                uint8_t* p = _buf + _last - BS_CONT_SIZE_LEN;
+                uint32_t size = _len - _last;
+                memcpy(&_last, p, BS_CONT_SIZE_LEN);
+                memcpy(p, &size, BS_CONT_SIZE_LEN);
+            }
+        }
+        push(cont);
+    }
+};
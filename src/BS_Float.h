@@ -0,0 +1,117 @@
+#pragma once
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+#include "BS_MACRO.h"
+
+// ============== FLOAT ==============
+// компактные формы BS_FLOAT: число с фиксированной точкой, half (2 байта), double (8 байт)
+class BSFloat {
+   public:
+    // 10 в степени dec [0..15]
+    static double pow10(uint8_t dec) {
+        static const double pw[] = {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+        return pw[dec & BS_DEC_MASK];
+    }
+
+    // размер данных после байта формы или -1 при ошибке
+    static int8_t extSize(uint8_t form) {
+        uint8_t size = BS_SIZE(form);
+        switch (BS_FLOAT_KIND(form)) {
+            case BS_FLOAT_FIX: return (size <= 8) ? size : -1;
+            case BS_FLOAT_HALF: return (size == 2 && !(form & BS_FLOAT_NEG)) ? size : -1;
+            case BS_FLOAT_DBL: return (size == 8 && !(form & BS_FLOAT_NEG)) ? size : -1;
+        }
+        return -1;
+    }
+
+    // значение: head - заголовок, p - данные после заголовка (форма проверена)
+    static double read(uint8_t head, const uint8_t* p) {
+        if (!(head & BS_FLOAT_EXT)) {
+            float f;
+            memcpy(&f, p, BS_FLOAT_SIZE);
+            return f;
+        }
+
+        uint8_t form = p[0];
+        switch (BS_FLOAT_KIND(form)) {
+            case BS_FLOAT_FIX: {
+                uint64_t v = 0;
+                memcpy(&v, p + 1, BS_SIZE(form));
+                double d = v / pow10(BS_DECIMAL(head));
+                return (form & BS_FLOAT_NEG) ? -d : d;
+            }
+            case BS_FLOAT_HALF: {
+                uint16_t h;
+                memcpy(&h, p + 1, 2);
+                return fromHalf(h);
+            }
+            case BS_FLOAT_DBL:
+                return fromDouble64(p + 1);
+        }
+        return 0;
+    }
+
+    // float -> half, с округлением
+    static uint16_t toHalf(float f) {
+        uint32_t x;
+        memcpy(&x, &f, 4);
+        uint16_t sign = (x >> 16) & 0x8000;
+        int16_t exp = ((x >> 23) & 0xff) - 127 + 15;
+        uint32_t mant = x & 0x7fffff;
+
+        if (((x >> 23) & 0xff) == 0xff) return sign | 0x7c00 | (mant ? 0x200 : 0);  // inf, nan
+        if (exp >= 31) return sign | 0x7c00;
+        if (exp <= 0) {
+            if (exp < -10) return sign;
+            mant |= 0x800000;
+            uint8_t shift = 14 - exp;
+            uint16_t h = mant >> shift;
+            if ((mant >> (shift - 1)) & 1) h++;
+            return sign | h;
+        }
+        uint16_t h = sign | (exp << 10) | (mant >> 13);
+        if (mant & 0x1000) h++;  // переполнение мантиссы корректно переходит в порядок
+        return h;
+    }
+
+    // half -> float
+    static float fromHalf(uint16_t h) {
+        uint32_t sign = uint32_t(h & 0x8000) << 16;
+        uint8_t exp = (h >> 10) & 0x1f;
+        uint32_t mant = h & 0x3ff;
+        uint32_t x;
+
+        if (exp == 0x1f) {
+            x = sign | 0x7f800000 | (mant << 13);
+        } else if (exp) {
+            x = sign | (uint32_t(exp - 15 + 127) << 23) | (mant << 13);
+        } else {
+            float f = ldexp(float(mant), -24);
+            return sign ? -f : f;
+        }
+        float f;
+        memcpy(&f, &x, 4);
+        return f;
+    }
+
+    // IEEE754 binary64 из буфера
+    static double fromDouble64(const uint8_t* p) {
+#if __SIZEOF_DOUBLE__ == 8
+        double d;
+        memcpy(&d, p, 8);
+        return d;
+#else
+        uint64_t x;
+        memcpy(&x, p, 8);
+        bool neg = x >> 63;
+        int16_t exp = (x >> 52) & 0x7ff;
+        double d;
+        if (exp == 0x7ff) d = (x << 12) ? NAN : INFINITY;
+        else if (!exp) d = 0;
+        else d = ldexp(1.0 + double(x >> 29 & 0x7fffff) / 8388608.0, exp - 1023);
+        return neg ? -d : d;
+#endif
+    }
+};
@@ -0,0 +1,222 @@
+#pragma once
+#include "BSON.h"
+
+#if !defined(ARDUINO) && (defined(__unix__) || defined(__APPLE__))
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#define BS_GATHER_IOV
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#endif
+
+// ============== GATHER ==============
+// сборка BSON списком сегментов для writev/sendmsg: заголовки и мелкие значения копируются во внутренний буфер,
+// данные от setMinRef() байт (строки, бинарные данные, типизированные массивы) записываются ссылкой на память
+// вызывающего без копирования. Данные по ссылкам должны существовать и не меняться до отправки пакета
+class BSON::Gather : public BSBuilder<BSON::Gather> {
+    typedef BSBuilder<BSON::Gather> BD;
+    friend class BSBuilder<BSON::Gather>;
+
+   public:
+    using BD::operator=;
+
+#ifdef BS_GATHER_IOV
+    typedef struct iovec Segment;
+#else
+    // сегмент, как struct iovec
+    struct Segment {
+        void* iov_base;
+        size_t iov_len;
+    };
+#endif
+
+    // minRef - данные от этого размера записываются ссылкой
+    Gather(size_t minRef = 256) {
+        setMinRef(minRef);
+    }
+
+    // данные от minRef байт записываются ссылкой, не меньше 16 (по умолчанию 256)
+    void setMinRef(size_t minRef) {
+        _min = minRef < 16 ? 16 : minRef;
+    }
+
+    // контейнеры с размером, как BSON::setSized(). Менять между пакетами
+    void setSized(bool sized) {
+        _sized = sized;
+    }
+
+    // добавить JSON. Строки из JSON всегда копируются
+    bool fromJson(const char* json, size_t len) {
+        size_t min = _min;
+        _min = (size_t)-1;
+        bool ok = BD::fromJson(json, len);
+        _min = min;
+        return ok;
+    }
+
+    // добавить JSON. Строки из JSON всегда копируются
+    bool fromJson(const char* json) {
+        return fromJson(json, strlen(json));
+    }
+
+    // записать байт
+    void push(uint8_t v) {
+        _buf.push(v);
+        _dirty = true;
+    }
+
+    // записать данные. Крупные данные из RAM записываются ссылкой
+    size_t write(const void* data, size_t len, bool pgm = false) {
+        _dirty = true;
+        if (len >= _min && !pgm) {
+            if (!_refs.push(_Ref{_buf.length(), (const uint8_t*)data, len})) return 0;
+            _ext += len;
+            return len;
+        }
+        return _buf.write(data, len, pgm);
+    }
+
+    // начать новый пакет
+    void clear() {
+        _buf.clear();
+        _refs.clear();
+        _conts.clear();
+        _iov.clear();
+        _ext = 0;
+        _dirty = false;
+    }
+
+    // размер пакета в байтах
+    size_t length() {
+        return _buf.length() + _ext;
+    }
+
+    // скопировано во внутренний буфер, байт
+    size_t copied() {
+        return _buf.length();
+    }
+
+    // сегменты пакета по порядку. Действительны до изменения пакета
+    const Segment* iov() {
+        _build();
+        return _iov.buf();
+    }
+
+    // количество сегментов
+    size_t segments() {
+        _build();
+        return _iov.length();
+    }
+
+    // собрать пакет одним буфером: дописать в out. Вернёт false при ошибке выделения памяти
+    bool flatten(BSON& out) {
+        _build();
+        out.reserve(out.length() + length());
+        for (size_t i = 0; i < _iov.length(); i++) {
+            const Segment& s = _iov.buf()[i];
+            if (out.write(s.iov_base, s.iov_len) != s.iov_len) return false;
+        }
+        return true;
+    }
+
+    // собрать пакет в буфер buf размером size. Вернёт длину пакета, 0 - не поместился
+    size_t flatten(uint8_t* buf, size_t size) {
+        if (length() > size) return 0;
+        _build();
+        uint8_t* p = buf;
+        for (size_t i = 0; i < _iov.length(); i++) {
+            const Segment& s = _iov.buf()[i];
+            memcpy(p, s.iov_base, s.iov_len);
+            p += s.iov_len;
+        }
+        return p - buf;
+    }
+
+#ifdef BS_GATHER_IOV
+    // записать пакет в файловый дескриптор через writev, неполные записи дописываются. Вернёт false при ошибке
+    bool writeTo(int fd) {
+        _build();
+        Segment* v = _iov.buf();
+        size_t n = _iov.length();
+        _dirty = true;  // сегменты сдвигаются при неполной записи
+
+        while (n) {
+            ssize_t w = ::writev(fd, v, n < IOV_MAX ? n : IOV_MAX);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            while (n && size_t(w) >= v->iov_len) {
+                w -= v->iov_len;
+                v++;
+                n--;
+            }
+            if (n) {
+                v->iov_base = (uint8_t*)v->iov_base + w;
+                v->iov_len -= w;
+            }
+        }
+        return true;
+    }
+#endif
+
+   private:
+    // ссылка на данные вызывающего, вставляется перед байтом at внутреннего буфера
+    struct _Ref {
+        size_t at;
+        const uint8_t* data;
+        size_t len;
+    };
+
+    // контейнер с размером: позиция размера в буфере и длина пакета после размера
+    struct _Cont {
+        size_t pos, start;
+    };
+
+    BSON _buf;
+    BSStack<_Ref> _refs;
+    BSStack<_Cont> _conts;
+    BSStack<Segment> _iov;
+    size_t _min = 256;
+    size_t _ext = 0;
+    bool _sized = false;
+    bool _dirty = false;
+
+    void _open(uint8_t cont) {
+        if (!_sized) return push(cont);
+        push(cont | BS_CONT_SIZED);
+        _conts.push(_Cont{_buf.length(), length() + BS_CONT_SIZE_LEN});
+        uint8_t zero[BS_CONT_SIZE_LEN] = {};
+        _buf.write(zero, BS_CONT_SIZE_LEN);
+    }
+
+    void _close(uint8_t cont) {
+        if (_sized && _conts.length()) {
+            _Cont c = _conts.pop();
+            uint32_t size = length() - c.start;
+            memcpy(_buf.buf() + c.pos, &size, BS_CONT_SIZE_LEN);
+        }
+        push(cont);
+    }
+
+    void _seg(const uint8_t* data, size_t len) {
+        _iov.push(Segment{(void*)data, len});
+    }
+
+    // сегменты из буфера и ссылок. Буфер мог переехать при росте, поэтому указатели берутся только здесь
+    void _build() {
+        if (!_dirty) return;
+        _dirty = false;
+        _iov.clear();
+        size_t pos = 0;
+        for (size_t i = 0; i < _refs.length(); i++) {
+            const _Ref& r = _refs.buf()[i];
+            if (r.at > pos) _seg(_buf.buf() + pos, r.at - pos);
+            _seg(r.data, r.len);
+            pos = r.at;
+        }
+        if (_buf.length() > pos) _seg(_buf.buf() + pos, _buf.length() - pos);
+    }
+};
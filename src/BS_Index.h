@@ -0,0 +1,246 @@
+#pragma once
+#include <stdlib.h>
+
+#include "BSON.h"
+
+// ============== INDEX ==============
+// индекс смещений для произвольного доступа по пути: idx["net"]["ports"][3]
+class BSON::Index {
+    struct Node {
+        uint32_t hash;   // хэш ключа [в объекте]
+        uint32_t key;    // позиция ключа [в объекте]
+        uint32_t pos;    // позиция значения
+        uint32_t end;    // конец значения
+        uint32_t child;  // первый вложенный в _nodes [Container]
+        uint32_t len;    // количество вложенных [Container]
+    };
+
+   public:
+    // ссылка на значение в индексе
+    class Ref {
+        friend class BSON::Index;
+
+       public:
+        Ref() {}
+
+        // значение по ключу [Object]
+        Ref operator[](const char* key) const {
+            return get(key, strlen(key));
+        }
+
+        // значение по индексу [Array]
+        Ref operator[](int i) const {
+            if (!isArray() || i < 0 || uint32_t(i) >= _n->len) return Ref();
+            return Ref(_idx, _idx->_child(*_n, i));
+        }
+
+        // значение по ключу с длиной [Object]
+        Ref get(const char* key, size_t len) const {
+            if (!isObject()) return Ref();
+            return Ref(_idx, _idx->_find(*_n, _hash(key, len), key, len));
+        }
+
+        // значение по ключу-коду [Object]
+        template <typename T>
+        Ref getCode(T code) const {
+            if (!isObject()) return Ref();
+            uint16_t c = uint16_t(code);
+            return Ref(_idx, _idx->_find(*_n, _hashCode(c), nullptr, c));
+        }
+
+        // значение найдено
+        bool valid() const {
+            return _n;
+        }
+        explicit operator bool() const {
+            return valid();
+        }
+
+        // значение - объект
+        bool isObject() const {
+            return _n && _n->len != _NO_CONT && _idx->_isObj(*_n);
+        }
+
+        // значение - массив
+        bool isArray() const {
+            return _n && _n->len != _NO_CONT && !_idx->_isObj(*_n);
+        }
+
+        // количество элементов [Container]
+        size_t length() const {
+            return (_n && _n->len != _NO_CONT) ? _n->len : 0;
+        }
+
+        // позиция значения в буфере
+        size_t offset() const {
+            return _n ? _n->pos : 0;
+        }
+
+        // размер значения в байтах
+        size_t size() const {
+            return _n ? _n->end - _n->pos : 0;
+        }
+
+        // парсер, установленный на значение. Первый next() прочитает его
+        BSON::Parser parser() const {
+            return _n ? BSON::Parser(_idx->_bson + _n->pos, _n->end - _n->pos) : BSON::Parser(_idx->_bson, 0);
+        }
+
+       private:
+        Ref(const Index* idx, const Node* n) : _idx(idx), _n(n) {}
+
+        const Index* _idx = nullptr;
+        const Node* _n = nullptr;
+    };
+
+    Index() {}
+    Index(uint8_t* bson, size_t len) { build(bson, len); }
+    Index(BSON& b) : Index(b.buf(), b.length()) {}
+
+    // построить индекс за один проход. Вернёт false при ошибке в пакете
+    bool build(uint8_t* bson, size_t len) {
+        _bson = bson;
+        _nodes.clear();
+        _root = Node{0, 0, 0, uint32_t(len), 0, 0};
+        _ok = false;
+
+        BSStack<Node> pend;       // значения открытых контейнеров
+        BSStack<uint32_t> conts;  // позиции контейнеров в pend
+        BSON::Parser p(bson, len);
+        bool obj = false, keyf = false;
+        uint32_t hash = 0, key = 0;
+
+        while (!p._ovf()) {
+            uint32_t pos = p._cur - bson;
+            if (!p.next()) return false;
+
+            bool close = p._type == BSType::Container && p.isClose();
+            if (obj && !keyf && !close) {
+                switch (p._type) {
+                    case BSType::String: hash = _hash(p.toStr(), p._data); break;
+                    case BSType::Code: hash = _hashCode(p._data); break;
+                    default: return false;
+                }
+                key = pos;
+                keyf = true;
+                continue;
+            }
+
+            if (close) {
+                if (!conts.length()) return false;
+                uint32_t ci = conts.pop();
+                Node& c = pend.buf()[ci];
+                if (bool(p._data & BS_CONT_OBJ) != _isObj(c) || (obj && keyf)) return false;
+
+                c.child = _nodes.length();
+                c.len = pend.length() - ci - 1;
+                c.end = p._cur - bson;
+                for (uint32_t i = ci + 1; i < pend.length(); i++) {
+                    if (!_nodes.push(pend.buf()[i])) return false;
+                }
+                while (pend.length() > ci + 1) pend.pop();
+                if (obj && c.len) qsort(_nodes.buf() + c.child, c.len, sizeof(Node), _cmp);
+
+                obj = conts.length() ? _isObj(pend.buf()[conts.last()]) : false;
+                keyf = false;
+                continue;
+            }
+
+            Node n{obj ? hash : 0, obj ? key : pos, pos, uint32_t(p._cur - bson), 0, _NO_CONT};
+            if (p._type == BSType::Container) {
+                n.len = 0;
+                if (!conts.push(pend.length())) return false;
+                obj = p.isObject();
+            }
+            if (!pend.push(n)) return false;
+            keyf = false;
+        }
+
+        if (conts.length()) return false;
+        _root.child = _nodes.length();
+        _root.len = pend.length();
+        for (uint32_t i = 0; i < pend.length(); i++) {
+            if (!_nodes.push(pend.buf()[i])) return false;
+        }
+        _ok = true;
+        return true;
+    }
+
+    // индекс построен успешно
+    bool valid() const {
+        return _ok;
+    }
+
+    // корень. Если в пакете одно значение - оно, иначе массив значений верхнего уровня
+    Ref root() const {
+        if (!_ok) return Ref();
+        return Ref(this, (_root.len == 1) ? _child(_root, 0) : &_root);
+    }
+
+    // значение по ключу в корне
+    Ref operator[](const char* key) const {
+        return root()[key];
+    }
+
+    // значение по индексу в корне
+    Ref operator[](int i) const {
+        return root()[i];
+    }
+
+    // количество записей в индексе
+    size_t length() const {
+        return _nodes.length();
+    }
+
+   private:
+    static const uint32_t _NO_CONT = 0xffffffff;
+
+    uint8_t* _bson = nullptr;
+    mutable BSStack<Node> _nodes;
+    Node _root;
+    bool _ok = false;
+
+    bool _isObj(const Node& n) const {
+        return &n != &_root && (_bson[n.pos] & BS_CONT_OBJ);
+    }
+
+    const Node* _child(const Node& n, uint32_t i) const {
+        return _nodes.buf() + n.child + i;
+    }
+
+    // key == nullptr - поиск кода len
+    const Node* _find(const Node& n, uint32_t hash, const char* key, size_t len) const {
+        const Node* arr = _child(n, 0);
+        uint32_t lo = 0, hi = n.len;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) >> 1;
+            if (arr[mid].hash < hash) lo = mid + 1;
+            else hi = mid;
+        }
+        for (; lo < n.len && arr[lo].hash == hash; lo++) {
+            const uint8_t* k = _bson + arr[lo].key;
+            if (BS_TYPE(k[0]) != (key ? BS_STRING : BS_CODE) || BS_D16_MERGE(BS_DATA(k[0]), k[1]) != len) continue;
+            if (!key || !memcmp(k + 2, key, len)) return arr + lo;
+        }
+        return nullptr;
+    }
+
+    // FNV-1a
+    static uint32_t _hash(const char* str, size_t len) {
+        uint32_t h = 2166136261ul;
+        while (len--) {
+            h ^= uint8_t(*str++);
+            h *= 16777619ul;
+        }
+        return h;
+    }
+
+    static uint32_t _hashCode(uint16_t code) {
+        return ~(code * 2654435761ul);
+    }
+
+    static int _cmp(const void* a, const void* b) {
+        uint32_t ha = ((const Node*)a)->hash, hb = ((const Node*)b)->hash;
+        return (ha > hb) - (ha < hb);
+    }
+};
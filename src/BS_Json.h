@@ -0,0 +1,579 @@
+#pragma once
+#include <float.h>
+
+#include "BSON.h"
+
+// ============== JSON ==============
+template <typename BS>
+bool BSBuilder<BS>::fromJson(const char* json, size_t len) {
+    enum class St : uint8_t {
+        Value,  // значение
+        First,  // значение или ] после [
+        Empty,  // ключ или } после {
+        Key,    // ключ
+        Colon,  // :
+        Next,   // , или закрытие
+    };
+    const char* p = json;
+    const char* end = json + len;
+    BSStack<uint8_t> conts;  // BS_CONT_OBJ / BS_CONT_ARR
+    BSStack<char> buf;       // строки с escape
+    St st = St::Value;
+    bool any = false;
+
+    while (true) {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+        if (p == end) break;
+        char c = *p;
+
+        if (c == ']' || c == '}') {
+            uint8_t cont = (c == '}') ? BS_CONT_OBJ : BS_CONT_ARR;
+            bool empty = (cont == BS_CONT_OBJ) ? (st == St::Empty) : (st == St::First);
+            if (!conts.length() || conts.last() != cont || !(st == St::Next || empty)) return false;
+            conts.pop();
+            _self()._close(cont == BS_CONT_OBJ ? BS_OBJ_CLOSE : BS_ARR_CLOSE);
+            ++p;
+            st = St::Next;
+            continue;
+        }
+
+        switch (st) {
+            case St::Next:
+                if (!conts.length()) {  // следующее значение верхнего уровня
+                    if (c == ',') ++p;
+                    st = St::Value;
+                    continue;
+                }
+                if (c != ',') return false;
+                ++p;
+                st = (conts.last() == BS_CONT_OBJ) ? St::Key : St::Value;
+                continue;
+
+            case St::Colon:
+                if (c != ':') return false;
+                ++p;
+                st = St::Value;
+                continue;
+
+            case St::Empty:
+            case St::Key: {
+                const char* str;
+                size_t slen;
+                if (c != '"' || !_jStr(p, end, buf, str, slen) || slen > BS_MAX_LEN) return false;
+                _key(str, slen);
+                st = St::Colon;
+            }
+                continue;
+
+            default:
+                break;
+        }
+
+        // St::Value, St::First
+        switch (c) {
+            case '{':
+            case '[':
+                if (!conts.push(c == '{' ? BS_CONT_OBJ : BS_CONT_ARR)) return false;
+                _self()._open(c == '{' ? BS_OBJ_OPEN : BS_ARR_OPEN);
+                ++p;
+                st = (c == '{') ? St::Empty : St::First;
+                any = true;
+                continue;
+
+            case '"': {
+                const char* str;
+                size_t slen;
+                if (!_jStr(p, end, buf, str, slen)) return false;
+                addStr(str, slen);
+            } break;
+
+            case 't':
+                if (end - p < 4 || memcmp(p, "true", 4)) return false;
+                p += 4;
+                add(true);
+                break;
+
+            case 'f':
+                if (end - p < 5 || memcmp(p, "false", 5)) return false;
+                p += 5;
+                add(false);
+                break;
+
+            case 'n':
+                if (end - p < 4 || memcmp(p, "null", 4)) return false;
+                p += 4;
+                addNull();
+                break;
+
+            default:
+                if (!_jNum(p, end)) return false;
+                break;
+        }
+        st = St::Next;
+        any = true;
+    }
+    return any && st == St::Next && !conts.length();
+}
+
+// первый '"', '\\' или управляющий символ. SWAR: проверка по машинному слову
+template <typename BS>
+const char* BSBuilder<BS>::_jScan(const char* p, const char* end) {
+    typedef size_t W;
+    const W ones = W(~W(0)) / 255;
+    const W highs = ones << 7;
+
+    while (size_t(end - p) >= sizeof(W)) {
+        W w;
+        memcpy(&w, p, sizeof(W));
+        W q = w ^ (ones * '"');
+        W b = w ^ (ones * '\\');
+        if ((((q - ones) & ~q) | ((b - ones) & ~b) | ((w - ones * 0x20) & ~w)) & highs) break;
+        p += sizeof(W);
+    }
+    while (p < end && *p != '"' && *p != '\\' && uint8_t(*p) >= 0x20) ++p;
+    return p;
+}
+
+// строка от '"'. Без escape - указатель во входные данные, иначе в buf
+template <typename BS>
+bool BSBuilder<BS>::_jStr(const char*& p, const char* end, BSStack<char>& buf, const char*& str, size_t& len) {
+    const char* s = ++p;
+    p = _jScan(p, end);
+    if (p == end) return false;
+    if (*p == '"') {
+        str = s;
+        len = p++ - s;
+        return true;
+    }
+
+    buf.clear();
+    while (true) {
+        for (; s < p; s++) buf.push(*s);
+        if (p == end || uint8_t(*p) < 0x20) return false;
+        if (*p == '"') break;
+
+        // escape
+        if (end - p < 2) return false;
+        char c = p[1];
+        p += 2;
+        switch (c) {
+            case '"':
+            case '\\':
+            case '/': buf.push(c); break;
+            case 'b': buf.push('\b'); break;
+            case 'f': buf.push('\f'); break;
+            case 'n': buf.push('\n'); break;
+            case 'r': buf.push('\r'); break;
+            case 't': buf.push('\t'); break;
+            case 'u': {
+                uint32_t u = 0;
+                for (uint8_t i = 0; i < 4; i++, p++) {
+                    if (p == end) return false;
+                    char h = *p;
+                    uint8_t d = (h >= '0' && h <= '9') ? h - '0' : ((h | 0x20) >= 'a' && (h | 0x20) <= 'f') ? (h | 0x20) - 'a' + 10 : 0xff;
+                    if (d == 0xff) return false;
+                    u = (u << 4) | d;
+                }
+                // суррогатная пара
+                if (u >= 0xd800 && u < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    const char* ps = p;
+                    p += 2;
+                    uint32_t lo = 0;
+                    for (uint8_t i = 0; i < 4 && p < end; i++, p++) {
+                        char h = *p;
+                        uint8_t d = (h >= '0' && h <= '9') ? h - '0' : ((h | 0x20) >= 'a' && (h | 0x20) <= 'f') ? (h | 0x20) - 'a' + 10 : 0xff;
+                        if (d == 0xff) return false;
+                        lo = (lo << 4) | d;
+                    }
+                    if (lo >= 0xdc00 && lo < 0xe000) u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+                    else p = ps;
+                }
+                if (u < 0x80) {
+                    buf.push(u);
+                } else if (u < 0x800) {
+                    buf.push(0xc0 | (u >> 6));
+                    buf.push(0x80 | (u & 0x3f));
+                } else if (u < 0x10000) {
+                    buf.push(0xe0 | (u >> 12));
+                    buf.push(0x80 | ((u >> 6) & 0x3f));
+                    buf.push(0x80 | (u & 0x3f));
+                } else {
+                    buf.push(0xf0 | (u >> 18));
+                    buf.push(0x80 | ((u >> 12) & 0x3f));
+                    buf.push(0x80 | ((u >> 6) & 0x3f));
+                    buf.push(0x80 | (u & 0x3f));
+                }
+            } break;
+            default:
+                return false;
+        }
+        s = p;
+        p = _jScan(p, end);
+    }
+    ++p;
+    str = buf.buf();
+    len = buf.length();
+    return true;
+}
+
+// число. Целое - минимальный размер, дробное - float с количеством знаков после точки
+template <typename BS>
+bool BSBuilder<BS>::_jNum(const char*& p, const char* end) {
+    bool neg = (*p == '-');
+    if (neg) ++p;
+    if (p == end || *p < '0' || *p > '9') return false;
+
+    uint64_t m = 0;
+    int16_t exp = 0;  // степень 10 для m, за ±1000 значение уже 0 или бесконечность
+    bool flt = false;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        uint8_t d = *p - '0';
+        if (m < 1844674407370955161ull || (m == 1844674407370955161ull && d <= 5)) m = m * 10 + d;
+        else if (exp < 1000) exp++, flt = true;
+    }
+    if (p < end && *p == '.') {
+        flt = true;
+        if (++p == end || *p < '0' || *p > '9') return false;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            if (m < 1844674407370955161ull && exp > -1000) m = m * 10 + (*p - '0'), exp--;
+        }
+    }
+    int16_t dec = -exp;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        flt = true;
+        if (++p < end && (*p == '+' || *p == '-')) ++p;
+        bool eneg = (p[-1] == '-');
+        if (p == end || *p < '0' || *p > '9') return false;
+        int16_t e = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            if (e < 1000) e = e * 10 + (*p - '0');
+        }
+        exp += eneg ? -e : e;
+        dec = -exp;
+    }
+
+    if (!flt) {
+        _int(&m, sizeof(m), neg && m);
+        return true;
+    }
+
+    static const double pw[] = {1e1, 1e2, 1e4, 1e8, 1e16, 1e32,
+#if DBL_MAX_10_EXP >= 256
+                                1e64, 1e128, 1e256
+#endif
+    };
+    const uint8_t n = sizeof(pw) / sizeof(pw[0]);
+    double v = m, s = 1;
+    uint16_t ae = exp < 0 ? -exp : exp;
+    if (exp < 0 && ae > DBL_MAX_10_EXP) {  // делитель не поместится в double: сначала на наибольшую степень
+        v /= pw[n - 1];
+        ae -= 1 << (n - 1);
+    }
+    for (uint8_t i = 0; ae && i < n; i++, ae >>= 1) {
+        if (ae & 1) s *= pw[i];
+    }
+    if (ae || !m) v = (exp < 0 || !m) ? 0 : INFINITY;  // за пределами double
+    else v = (exp < 0) ? v / s : v * s;
+    if (neg) v = -v;
+    if (dec > BS_DEC_MASK && v) {  // знаков больше, чем у фиксированной точки: float или double без округления
+#ifndef BSON_NO_COMPACT_FLOAT
+        if (double(float(v)) != v && sizeof(double) == 8) {
+            _self().push(BS_FLOAT | BS_FLOAT_EXT | BS_DEC_MASK);
+            _self().push(BS_FLOAT_DBL | 8);
+            _self().write(&v, 8);
+            return true;
+        }
+#endif
+        _float(v, BS_DEC_MASK);
+        return true;
+    }
+    add(v, dec < 0 ? 0 : dec);
+    return true;
+}
+
+// ============== STRINGIFY ==============
+template <typename Out>
+void BSON::_stringify(const uint8_t* bson, size_t len, Out& out, bool pretty, const BSDictionary* dict, const char* eol) {
+    const uint8_t* end = bson + len;
+    BSStack<uint8_t> stack;  // 1 - объект
+    bool first = true;       // первое значение в контейнере
+    bool val = false;        // в объекте ожидается значение
+    size_t eolLen = strlen(eol);
+    char num[48];
+
+    auto newline = [&](size_t depth) {
+        out.write(eol, eolLen);
+        while (depth--) out.write("   ", 3);
+    };
+
+    while (bson < end) {
+        uint8_t type = BS_TYPE(*bson);
+        uint8_t data = BS_DATA(*bson);
+        ++bson;
+
+        if (type == BS_CONTAINER && !(data & BS_CONT_OPEN)) {
+            if (!stack.length()) return;
+            stack.pop();
+            if (pretty && !first) newline(stack.length());
+            out.write((data & BS_CONT_OBJ) ? "}" : "]", 1);
+            first = false;
+            val = false;
+            continue;
+        }
+
+        bool obj = stack.length() && stack.last();
+        if (obj && val) {
+            out.write(":", 1);
+        } else {
+            if (!first) out.write(",", 1);
+            if (pretty && (stack.length() || !first)) newline(stack.length());
+        }
+
+        switch (type) {
+            case BS_CONTAINER:
+                if (bson[-1] == BS_TYPED_ARR) {
+                    size_t n = _taLen(bson - 1, end - bson + 1);
+                    if (!n) return;
+                    uint8_t t = *bson;
+                    uint8_t size = BS_TA_SIZE(t);
+                    const uint8_t* d = bson + 1 + BS_TA_CNT_LEN(t);
+                    bson += n - 1;
+                    out.write("[", 1);
+                    for (const uint8_t* i = d; i < bson; i += size) {
+                        if (i != d) out.write(",", 1);
+                        out.write(num, _jsonElem(num, i, t));
+                    }
+                    out.write("]", 1);
+                    break;
+                }
+                if (bson[-1] == BS_SOBJ_OPEN) {  // таблица смещений не выводится
+                    if (size_t(end - bson) < BS_CONT_SIZE_LEN + BS_SOBJ_CNT_LEN) return;
+                    uint16_t cnt;
+                    memcpy(&cnt, bson + BS_CONT_SIZE_LEN, BS_SOBJ_CNT_LEN);
+                    size_t tlen = BS_CONT_SIZE_LEN + BS_SOBJ_CNT_LEN + cnt * BS_SOBJ_OFFS_LEN;
+                    if (tlen > size_t(end - bson)) return;
+                    bson += tlen;
+                } else if (data & BS_CONT_SIZED) {
+                    bson += BS_CONT_SIZE_LEN;
+                }
+                out.write((data & BS_CONT_OBJ) ? "{" : "[", 1);
+                if (!stack.push((data & BS_CONT_OBJ) ? 1 : 0)) return;
+                first = true;
+                val = false;
+                continue;
+
+            case BS_NULL:
+                if (bson[-1] != BS_STR_EXT && bson[-1] != BS_BIN_EXT) {
+                    out.write("null", 4);
+                    break;
+                }
+                // fallthrough
+
+            case BS_STRING:
+            case BS_BINARY:
+            case BS_CODE: {
+                size_t n;
+                if (type == BS_NULL) {  // длина 4 байта
+                    if (size_t(end - bson) < BS_EXT_LEN) return;
+                    uint32_t len;
+                    memcpy(&len, bson, BS_EXT_LEN);
+                    type = (bson[-1] == BS_STR_EXT) ? BS_STRING : BS_BINARY;
+                    bson += BS_EXT_LEN;
+                    n = len;
+                } else {
+                    if (bson == end) return;
+                    n = BS_D16_MERGE(data, *bson++);
+                }
+                if (type == BS_CODE) {
+                    const char* str = (dict && obj && !val) ? dict->get(n) : nullptr;  // только ключи
+                    if (str) {
+                        _jsonStr(out, str, strlen(str));
+                    } else {
+                        out.write("\"#", 2);
+                        uint8_t k = _jsonUint(num + sizeof(num), n);
+                        out.write(num + sizeof(num) - k, k);
+                        out.write("\"", 1);
+                    }
+                    break;
+                }
+                if (n > size_t(end - bson)) return;
+                if (type == BS_STRING) {
+                    _jsonStr(out, (const char*)bson, n);
+                } else {
+                    out.write("\"<bin:", 6);
+                    uint8_t k = _jsonUint(num + sizeof(num), n);
+                    out.write(num + sizeof(num) - k, k);
+                    out.write(">\"", 2);
+                }
+                bson += n;
+            } break;
+
+            case BS_BOOLEAN:
+                BS_BOOLV(data) ? out.write("true", 4) : out.write("false", 5);
+                break;
+
+            case BS_INTEGER: {
+                uint8_t size = BS_SIZE(data);
+                if (size > 8 || size > size_t(end - bson)) return;
+                uint64_t v = 0;
+                memcpy(&v, bson, size);
+                bson += size;
+                if (BS_NEGATIVE(data)) out.write("-", 1);
+                uint8_t k = _jsonUint(num + sizeof(num), v);
+                out.write(num + sizeof(num) - k, k);
+            } break;
+
+            case BS_FLOAT: {
+                size_t size = BS_FLOAT_SIZE;
+                if (data & BS_FLOAT_EXT) {
+                    if (bson == end || BSFloat::extSize(*bson) < 0) return;
+                    size = 1 + BSFloat::extSize(*bson);
+                }
+                if (size_t(end - bson) < size) return;
+                double v = BSFloat::read(data, bson);
+                bson += size;
+                out.write(num, _jsonFloat(num, v, BS_DECIMAL(data)));
+            } break;
+        }
+
+        if (obj) val = !val;
+        first = false;
+    }
+}
+
+// строка в кавычках. Участки без спецсимволов выводятся целиком
+template <typename Out>
+void BSON::_jsonStr(Out& out, const char* str, size_t len) {
+    const char* end = str + len;
+    out.write("\"", 1);
+
+    while (true) {
+        const char* p = _jScan(str, end);
+        if (p != str) out.write(str, p - str);
+        if (p == end) break;
+
+        char e[6] = {'\\', 0, '0', '0', 0, 0};
+        uint8_t n = 2;
+        switch (*p) {
+            case '"': e[1] = '"'; break;
+            case '\\': e[1] = '\\'; break;
+            case '\b': e[1] = 'b'; break;
+            case '\f': e[1] = 'f'; break;
+            case '\n': e[1] = 'n'; break;
+            case '\r': e[1] = 'r'; break;
+            case '\t': e[1] = 't'; break;
+            default:
+                e[1] = 'u';
+                e[4] = "0123456789abcdef"[uint8_t(*p) >> 4];
+                e[5] = "0123456789abcdef"[*p & 0xf];
+                n = 6;
+                break;
+        }
+        out.write(e, n);
+        str = p + 1;
+    }
+    out.write("\"", 1);
+}
+
+// записать число перед end, вернёт количество символов
+inline uint8_t BSON::_jsonUint(char* end, uint64_t v) {
+    char* p = end;
+#ifdef __AVR__
+    if (v <= 0xfffffffful) {
+        uint32_t w = v;
+        do *--p = '0' + w % 10;
+        while (w /= 10);
+        return end - p;
+    }
+    do *--p = '0' + v % 10;
+    while (v /= 10);
+#else
+    static const char digits[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+    while (v >= 100) {
+        const char* d = digits + (v % 100) * 2;
+        v /= 100;
+        *--p = d[1];
+        *--p = d[0];
+    }
+    if (v >= 10) {
+        *--p = digits[v * 2 + 1];
+        *--p = digits[v * 2];
+    } else {
+        *--p = '0' + v;
+    }
+#endif
+    return end - p;
+}
+
+// записать элемент типизированного массива в buf [48], вернёт количество символов
+inline uint8_t BSON::_jsonElem(char* buf, const uint8_t* p, uint8_t type) {
+    uint8_t size = BS_TA_SIZE(type);
+    if (type & BS_TA_FLOAT) {
+        double v;
+        if (size == 4) {
+            float f;
+            memcpy(&f, p, 4);
+            v = f;
+        } else {
+            memcpy(&v, p, 8);
+        }
+        return _jsonFloat(buf, v, 4);
+    }
+
+    uint64_t v = 0;
+    memcpy(&v, p, size);
+    uint8_t n = 0;
+    if ((type & BS_TA_SIGNED) && (v >> (size * 8 - 1))) {
+        if (size < 8) v |= ~uint64_t(0) << (size * 8);
+        v = -v;
+        buf[n++] = '-';
+    }
+    char tmp[20];
+    uint8_t k = _jsonUint(tmp + sizeof(tmp), v);
+    memcpy(buf + n, tmp + sizeof(tmp) - k, k);
+    return n + k;
+}
+
+// записать число с dec знаков после точки в buf [48], вернёт количество символов
+inline uint8_t BSON::_jsonFloat(char* buf, double v, uint8_t dec) {
+    if (v != v || v - v != 0) {  // nan, inf
+        memcpy(buf, "null", 4);
+        return 4;
+    }
+    char tmp[20];
+    uint8_t n = 0, k;
+    double x = v;
+    if (x < 0) {
+        buf[n++] = '-';
+        x = -x;
+    }
+    x += 0.5 / BSFloat::pow10(dec);
+
+    if (x >= 1e19) {
+        int16_t e = 0;
+        while (x >= 1e15) x /= 10, e++;
+        k = _jsonUint(tmp + sizeof(tmp), uint64_t(x));
+        memcpy(buf + n, tmp + sizeof(tmp) - k, k);
+        n += k;
+        buf[n++] = 'e';
+        k = _jsonUint(tmp + sizeof(tmp), e);
+        memcpy(buf + n, tmp + sizeof(tmp) - k, k);
+        return n + k;
+    }
+
+    uint64_t ip = x;
+    k = _jsonUint(tmp + sizeof(tmp), ip);
+    memcpy(buf + n, tmp + sizeof(tmp) - k, k);
+    n += k;
+    if (dec) {
+        buf[n++] = '.';
+        double m = BSFloat::pow10(dec);
+        uint64_t f = (x - ip) * m;
+        if (f >= m) f = m - 1;
+        k = _jsonUint(tmp + sizeof(tmp), f);
+        for (uint8_t i = k; i < dec; i++) buf[n++] = '0';
+        memcpy(buf + n, tmp + sizeof(tmp) - k, k);
+        n += k;
+    }
+    return n;
+}
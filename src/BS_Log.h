@@ -0,0 +1,305 @@
+#pragma once
+#include "BSON.h"
+
+#if !defined(ARDUINO) && (defined(__unix__) || defined(__APPLE__))
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BS_LOG
+
+// ============== LOG ==============
+// файл-журнал пакетов: [маркер] [длина + флаг CRC][CRC32][пакет] ... Маркер синхронизации пишется
+// в начале каждой записи в файл и через каждые syncEvery байт, по нему читатель восстанавливается после порчи
+#define BS_LOG_MARKER "\xff\xff\xff\xff" "BSLG"
+#define BS_LOG_MARKER_LEN 8
+#define BS_LOG_CRC (1ul << 31)
+
+class BSON::LogWriter {
+   public:
+    LogWriter() {}
+    LogWriter(const LogWriter&) = delete;
+    LogWriter& operator=(const LogWriter&) = delete;
+    ~LogWriter() {
+        close();
+    }
+
+    // открыть файл на дозапись. Вернёт false при ошибке
+    bool open(const char* path) {
+        close();
+        _fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        _marker = true;
+        _err = _fd < 0;
+        return !_err;
+    }
+
+    // записать буфер и закрыть файл
+    void close() {
+        if (_fd < 0) return;
+        flush();
+        ::close(_fd);
+        _fd = -1;
+    }
+
+    // записывать CRC32 пакетов (по умолчанию вкл)
+    void setChecksum(bool crc) {
+        _crc = crc;
+    }
+
+    // интервал маркеров синхронизации в байтах (по умолчанию 64 кБ)
+    void setSyncEvery(size_t bytes) {
+        _every = bytes;
+    }
+
+    // размер буфера записи (по умолчанию 64 кБ)
+    void setBuffer(size_t size) {
+        _size = size;
+    }
+
+    // добавить пакет
+    bool append(const uint8_t* bson, size_t len) {
+        if (_fd < 0 || len >= BS_LOG_CRC) return false;
+        if (_marker || _since >= _every) {
+            _put((const uint8_t*)BS_LOG_MARKER, BS_LOG_MARKER_LEN);
+            _marker = false;
+            _since = 0;
+        }
+
+        uint32_t head = len | (_crc ? BS_LOG_CRC : 0);
+        _put((const uint8_t*)&head, 4);
+        if (_crc) {
+            uint32_t crc = crc32(bson, len);
+            _put((const uint8_t*)&crc, 4);
+        }
+        _put(bson, len);
+        _since += len;
+        _count++;
+        return !_err;
+    }
+
+    // добавить пакет
+    bool append(BSON& bson) {
+        return append(bson.buf(), bson.length());
+    }
+
+    // записать буфер в файл
+    bool flush() {
+        _write(_buf.buf(), _buf.length());
+        _buf.clear();
+        return !_err;
+    }
+
+    // записать буфер и сбросить файл на диск
+    bool sync() {
+        return flush() && _fd >= 0 && !fsync(_fd);
+    }
+
+    // добавлено пакетов
+    size_t count() const {
+        return _count;
+    }
+
+    // была ошибка записи
+    bool error() const {
+        return _err;
+    }
+
+    // CRC32 (IEEE), по 4 байта за шаг
+    static uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+        struct Tab {
+            uint32_t t[4][256];
+            Tab() {
+                for (uint32_t i = 0; i < 256; i++) {
+                    uint32_t c = i;
+                    for (uint8_t k = 0; k < 8; k++) c = (c >> 1) ^ ((c & 1) ? 0xedb88320ul : 0);
+                    t[0][i] = c;
+                }
+                for (uint32_t i = 0; i < 256; i++) {
+                    for (uint8_t k = 1; k < 4; k++) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+                }
+            }
+        };
+        static const Tab tab;
+        const uint32_t(*t)[256] = tab.t;
+
+        crc = ~crc;
+        for (; len >= 4; len -= 4, data += 4) {
+            uint32_t v;
+            memcpy(&v, data, 4);
+            crc ^= v;
+            crc = t[3][crc & 0xff] ^ t[2][(crc >> 8) & 0xff] ^ t[1][(crc >> 16) & 0xff] ^ t[0][crc >> 24];
+        }
+        while (len--) crc = t[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+   private:
+    BSStack<uint8_t> _buf;
+    size_t _size = 1ul << 16;
+    size_t _every = 1ul << 16;
+    size_t _since = 0;
+    size_t _count = 0;
+    int _fd = -1;
+    bool _crc = true;
+    bool _marker = true;
+    bool _err = false;
+
+    // крупные данные пишутся напрямую, минуя буфер
+    void _put(const uint8_t* data, size_t len) {
+        if (_buf.length() + len > _size) flush();
+        if (len >= _size) _write(data, len);
+        else _buf.concat(data, len);
+    }
+
+    void _write(const uint8_t* data, size_t len) {
+        while (len && _fd >= 0) {
+            ssize_t w = ::write(_fd, data, len);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                _err = true;
+                return;
+            }
+            data += w;
+            len -= w;
+        }
+    }
+};
+
+// чтение журнала из памяти или файла через mmap, пакеты отдаются без копирования
+class BSON::LogReader {
+   public:
+    LogReader() {}
+
+    // журнал в памяти
+    LogReader(const uint8_t* data, size_t len) : _data(data), _len(len) {}
+
+    LogReader(const LogReader&) = delete;
+    LogReader& operator=(const LogReader&) = delete;
+
+    ~LogReader() {
+        close();
+    }
+
+    // отобразить файл в память. Вернёт false при ошибке
+    bool open(const char* path) {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        bool ok = !fstat(fd, &st);
+        if (ok && st.st_size) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = p != MAP_FAILED;
+            if (ok) {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                _data = (const uint8_t*)p;
+                _len = st.st_size;
+                _map = true;
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+
+    // закрыть файл
+    void close() {
+        if (_map) munmap((void*)_data, _len);
+        _data = nullptr;
+        _len = _pos = _rec = _recLen = 0;
+        _map = false;
+        _errors = 0;
+    }
+
+    // проверять пакеты без CRC через validate() (по умолчанию выкл)
+    void setValidate(bool validate) {
+        _validate = validate;
+    }
+
+    // перейти к следующему пакету. Испорченные участки пропускаются до маркера. Вернёт false в конце журнала
+    bool next() {
+        while (_pos < _len) {
+            size_t left = _len - _pos;
+            const uint8_t* p = _data + _pos;
+            if (left >= BS_LOG_MARKER_LEN && !memcmp(p, BS_LOG_MARKER, BS_LOG_MARKER_LEN)) {
+                _pos += BS_LOG_MARKER_LEN;
+                continue;
+            }
+
+            uint32_t head;
+            if (left >= 4) {
+                memcpy(&head, p, 4);
+                size_t hlen = (head & BS_LOG_CRC) ? 8 : 4;
+                size_t len = head & ~BS_LOG_CRC;
+                if (left >= hlen && len <= left - hlen) {
+                    bool ok = true;
+                    if (head & BS_LOG_CRC) {
+                        uint32_t crc;
+                        memcpy(&crc, p + 4, 4);
+                        ok = crc == LogWriter::crc32(p + hlen, len);
+                    } else if (_validate) {
+                        ok = BSON::validate(p + hlen, len);
+                    }
+                    if (ok) {
+                        _rec = _pos + hlen;
+                        _recLen = len;
+                        _pos = _rec + len;
+                        return true;
+                    }
+                }
+            }
+            _errors++;
+            _resync();
+        }
+        return false;
+    }
+
+    // пакет
+    const uint8_t* data() const {
+        return _data + _rec;
+    }
+
+    // длина пакета
+    size_t length() const {
+        return _recLen;
+    }
+
+    // позиция пакета в журнале
+    size_t offset() const {
+        return _rec;
+    }
+
+    // парсер пакета
+    Parser parser() const {
+        return Parser((uint8_t*)data(), length());
+    }
+
+    // испорченных участков
+    size_t errors() const {
+        return _errors;
+    }
+
+    // начать сначала
+    void rewind() {
+        _pos = _rec = _recLen = 0;
+        _errors = 0;
+    }
+
+   private:
+    const uint8_t* _data = nullptr;
+    size_t _len = 0;
+    size_t _pos = 0;
+    size_t _rec = 0;
+    size_t _recLen = 0;
+    size_t _errors = 0;
+    bool _map = false;
+    bool _validate = false;
+
+    void _resync() {
+        const uint8_t* p = (const uint8_t*)memmem(_data + _pos + 1, _len - _pos - 1, BS_LOG_MARKER, BS_LOG_MARKER_LEN);
+        _pos = p ? p - _data : _len;
+    }
+};
+
+#endif
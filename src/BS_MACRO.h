@@ -15,14 +15,36 @@
 #define BS_CONT_OPEN (1 << 3)
 #define BS_CONT_ARR (1 << 2)
 #define BS_CONT_CLOSE (1 << 1)
+#define BS_CONT_SIZED (1 << 0)
 
 #define BS_OBJ_OPEN (BS_CONTAINER | BS_CONT_OBJ | BS_CONT_OPEN)
 #define BS_OBJ_CLOSE (BS_CONTAINER | BS_CONT_OBJ | BS_CONT_CLOSE)
 #define BS_ARR_OPEN (BS_CONTAINER | BS_CONT_ARR | BS_CONT_OPEN)
 #define BS_ARR_CLOSE (BS_CONTAINER | BS_CONT_ARR | BS_CONT_CLOSE)
 
+// типизированный массив: заголовок, тип элемента, количество (1/2/4 байт), данные
+#define BS_TYPED_ARR (BS_CONTAINER | BS_CONT_ARR | BS_CONT_OPEN | BS_CONT_CLOSE)
+#define BS_TA_SIGNED (1 << 4)
+#define BS_TA_FLOAT (1 << 5)
+#define BS_TA_SIZE(x) ((x) & 0b1111)
+#define BS_TA_ELEM(x) ((x) & 0b111111)
+#define BS_TA_CNT_LEN(x) (1 << ((x) >> 6))
+// отсортированный объект: заголовок, размер, количество пар (2 байта), смещения пар от первой пары (4 байта), пары
+#define BS_SOBJ_OPEN (BS_OBJ_OPEN | BS_CONT_ARR | BS_CONT_SIZED)
+#define BS_SOBJ_CNT_LEN 2
+#define BS_SOBJ_OFFS_LEN 4
+// длинные строки и бинарные данные (длиннее BS_MAX_LEN): заголовок, длина (4 байта), данные
+#define BS_STR_EXT (BS_NULL | 1)
+#define BS_BIN_EXT (BS_NULL | 2)
+#define BS_EXT_LEN 4
+
+#define BS_TA_TYPE(T) (sizeof(T) | ((T)0.5 != (T)0 ? BS_TA_FLOAT : ((T)-1 < (T)0 ? BS_TA_SIGNED : 0)))
+// тип элемента типизированного массива: целые 1, 2, 4, 8 байт (не bool), float, double
+#define BS_TA_VALID(T) ((sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8) && (T)2 != (T)1 && ((T)0.5 == (T)0 || sizeof(T) >= 4))
+
 // ============== MACRO ==============
 #define BS_MAX_LEN 0b0001111111111111u
+#define BS_MAX_EXT_LEN 0xffffffffu
 
 #define BS_TYPE_MASK 0b11100000
 #define BS_TYPE(x) ((x) & BS_TYPE_MASK)
@@ -39,6 +61,15 @@
 #define BS_SIZE(x) ((x) & BS_SIZE_MASK)
 
 #define BS_FLOAT_SIZE 4
+#define BS_FLOAT_EXT (1 << 4)  // в заголовке: далее байт формы и данные
+
+// байт формы: знак, вид, размер данных
+#define BS_FLOAT_NEG (1 << 7)
+#define BS_FLOAT_FIX (0 << 4)
+#define BS_FLOAT_HALF (1 << 4)
+#define BS_FLOAT_DBL (2 << 4)
+#define BS_FLOAT_KIND(x) ((x) & 0b110000)
+#define BS_CONT_SIZE_LEN 4
 #define BS_DEC_MASK 0b1111
 #define BS_DECIMAL(x) ((x) & BS_DEC_MASK)
 
@@ -133,3 +164,51 @@ inline constexpr uint8_t BSON_CONT(char t) { return t == '{' ? BS_OBJ_OPEN : (t
 #define BSON_CHARS(...) BS_STRING | BS_D16_MSB(BS_NARG(__VA_ARGS__)), BS_D16_LSB(BS_NARG(__VA_ARGS__)), __VA_ARGS__
 #define BSON_KEY(str, len) BSON_STR(str, len)
 #define BSON_NULL() BS_NULL
+
+// =========== STRUCT FIELDS ==========
+#define _BS_CAT(a, b) _BS_CAT_(a, b)
+#define _BS_CAT_(a, b) a##b
+
+#define _BS_FE1(m, i, x) m(i, x)
+#define _BS_FE2(m, i, x, ...) m(i, x) _BS_FE1(m, i + 1, __VA_ARGS__)
+#define _BS_FE3(m, i, x, ...) m(i, x) _BS_FE2(m, i + 1, __VA_ARGS__)
+#define _BS_FE4(m, i, x, ...) m(i, x) _BS_FE3(m, i + 1, __VA_ARGS__)
+#define _BS_FE5(m, i, x, ...) m(i, x) _BS_FE4(m, i + 1, __VA_ARGS__)
+#define _BS_FE6(m, i, x, ...) m(i, x) _BS_FE5(m, i + 1, __VA_ARGS__)
+#define _BS_FE7(m, i, x, ...) m(i, x) _BS_FE6(m, i + 1, __VA_ARGS__)
+#define _BS_FE8(m, i, x, ...) m(i, x) _BS_FE7(m, i + 1, __VA_ARGS__)
+#define _BS_FE9(m, i, x, ...) m(i, x) _BS_FE8(m, i + 1, __VA_ARGS__)
+#define _BS_FE10(m, i, x, ...) m(i, x) _BS_FE9(m, i + 1, __VA_ARGS__)
+#define _BS_FE11(m, i, x, ...) m(i, x) _BS_FE10(m, i + 1, __VA_ARGS__)
+#define _BS_FE12(m, i, x, ...) m(i, x) _BS_FE11(m, i + 1, __VA_ARGS__)
+#define _BS_FE13(m, i, x, ...) m(i, x) _BS_FE12(m, i + 1, __VA_ARGS__)
+#define _BS_FE14(m, i, x, ...) m(i, x) _BS_FE13(m, i + 1, __VA_ARGS__)
+#define _BS_FE15(m, i, x, ...) m(i, x) _BS_FE14(m, i + 1, __VA_ARGS__)
+#define _BS_FE16(m, i, x, ...) m(i, x) _BS_FE15(m, i + 1, __VA_ARGS__)
+#define _BS_FE17(m, i, x, ...) m(i, x) _BS_FE16(m, i + 1, __VA_ARGS__)
+#define _BS_FE18(m, i, x, ...) m(i, x) _BS_FE17(m, i + 1, __VA_ARGS__)
+#define _BS_FE19(m, i, x, ...) m(i, x) _BS_FE18(m, i + 1, __VA_ARGS__)
+#define _BS_FE20(m, i, x, ...) m(i, x) _BS_FE19(m, i + 1, __VA_ARGS__)
+#define _BS_FE21(m, i, x, ...) m(i, x) _BS_FE20(m, i + 1, __VA_ARGS__)
+#define _BS_FE22(m, i, x, ...) m(i, x) _BS_FE21(m, i + 1, __VA_ARGS__)
+#define _BS_FE23(m, i, x, ...) m(i, x) _BS_FE22(m, i + 1, __VA_ARGS__)
+#define _BS_FE24(m, i, x, ...) m(i, x) _BS_FE23(m, i + 1, __VA_ARGS__)
+#define _BS_FE25(m, i, x, ...) m(i, x) _BS_FE24(m, i + 1, __VA_ARGS__)
+#define _BS_FE26(m, i, x, ...) m(i, x) _BS_FE25(m, i + 1, __VA_ARGS__)
+#define _BS_FE27(m, i, x, ...) m(i, x) _BS_FE26(m, i + 1, __VA_ARGS__)
+#define _BS_FE28(m, i, x, ...) m(i, x) _BS_FE27(m, i + 1, __VA_ARGS__)
+#define _BS_FE29(m, i, x, ...) m(i, x) _BS_FE28(m, i + 1, __VA_ARGS__)
+#define _BS_FE30(m, i, x, ...) m(i, x) _BS_FE29(m, i + 1, __VA_ARGS__)
+#define _BS_FE31(m, i, x, ...) m(i, x) _BS_FE30(m, i + 1, __VA_ARGS__)
+#define _BS_FE32(m, i, x, ...) m(i, x) _BS_FE31(m, i + 1, __VA_ARGS__)
+#define _BS_FOREACH(m, ...) _BS_CAT(_BS_FE, BS_NARG(__VA_ARGS__))(m, 0, __VA_ARGS__)
+
+#define _BS_FIELD(i, x) f(i, #x, sizeof(#x) - 1, x);
+
+// список полей структуры для BSON::encode() / Parser::decode(), до 32 полей. Внутри структуры:
+// struct Data { int a; float b; BSON_FIELDS(a, b) };
+#define BSON_FIELDS(...)                                            \
+    template <typename F>                                           \
+    void bsonFields(F& f) { _BS_FOREACH(_BS_FIELD, __VA_ARGS__) }   \
+    template <typename F>                                           \
+    void bsonFields(F& f) const { _BS_FOREACH(_BS_FIELD, __VA_ARGS__) }
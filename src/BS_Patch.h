@@ -0,0 +1,269 @@
+#pragma once
+#include "BSON.h"
+
+// ============== PATCH ==============
+// патч - пакет [ {"путь": значение, ...}, ["удалённый путь", ...] ], путь как у Editor (точка в ключе экранируется).
+// Объекты сравниваются по ключам, массивы одинаковой длины - по элементам, остальное заменяется целиком.
+// Новые ключи дописываются в конец объекта, порядок ключей не сохраняется.
+// Отсортированный объект с изменённым набором ключей заменяется целиком
+struct BSON::_Patch {
+    struct Pair {
+        const char* key;
+        uint16_t len;
+        uint32_t val;  // позиция значения
+    };
+
+    const uint8_t *prev, *cur;
+    size_t plen, clen;
+    const BSDictionary* dict;
+    BSON& sets;
+    BSON& rms;
+    BSStack<char> path;
+
+    Parser parser(const uint8_t* buf, size_t len, uint32_t pos) {
+        Parser p((uint8_t*)buf, len);
+        p.setDictionary(dict);
+        p._cur += pos;
+        return p;
+    }
+
+    // конец значения с позиции pos
+    bool end(const uint8_t* buf, size_t len, uint32_t pos, uint32_t& end) {
+        Parser p = parser(buf, len, pos);
+        if (!p.next() || (p.isOpen() && !p.skip())) return false;
+        end = p._cur - buf;
+        return true;
+    }
+
+    // количество элементов массива с позиции pos
+    bool count(const uint8_t* buf, size_t len, uint32_t pos, uint32_t& n) {
+        Parser p = parser(buf, len, pos);
+        if (!p.next()) return false;
+        for (n = 0;; n++) {
+            if (!p.next()) return false;
+            if (p.isClose()) return true;
+            if (!p.skip()) return false;
+        }
+    }
+
+    // следующая пара объекта. false - конец объекта или ошибка (err)
+    static bool pair(Parser& p, Pair& k, bool& err) {
+        err = true;
+        if (!p.next()) return false;
+        if (p.isClose()) return err = false;
+        if (p._type != BSType::String) return false;
+        k.key = (const char*)p.toStr();
+        k.len = p._data;
+        k.val = p._cur - p._bson;
+        if (!p.next() || (p.isOpen() && !p.skip())) return false;
+        err = false;
+        return true;
+    }
+
+    // найти ключ в объекте с позиции obj. hint - позиция ожидаемой пары, сдвигается за найденную
+    bool find(const uint8_t* buf, size_t len, uint32_t obj, uint32_t& hint, const Pair& key, uint32_t& val, bool& err) {
+        Pair k;
+        Parser p = parser(buf, len, hint);
+        p._inObject();
+        if (pair(p, k, err) && k.len == key.len && !memcmp(k.key, key.key, k.len)) {
+            val = k.val;
+            hint = p._cur - buf;
+            return true;
+        }
+        if (err) return false;
+
+        p = parser(buf, len, obj);
+        p.next();
+        while (pair(p, k, err)) {
+            if (k.len == key.len && !memcmp(k.key, key.key, k.len)) {
+                val = k.val;
+                hint = p._cur - buf;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // заголовок без флага размера, отсортированный объект - как обычный
+    static uint8_t head(uint8_t h) {
+        return h == BS_SOBJ_OPEN ? BS_OBJ_OPEN : (h & ~BS_CONT_SIZED);
+    }
+
+    // первая пара объекта с позиции obj
+    uint32_t first(const uint8_t* buf, size_t len, uint32_t obj) {
+        Parser p = parser(buf, len, obj);
+        p.next();
+        return p._cur - buf;
+    }
+
+    void push(const char* str, size_t len) {
+        if (path.length()) path.push('.');
+        for (size_t i = 0; i < len; i++) {
+            if (str[i] == '.' || str[i] == '\\') path.push('\\');
+            path.push(str[i]);
+        }
+    }
+    void pop(size_t len) {
+        while (path.length() > len) path.pop();
+    }
+
+    bool set(const uint8_t* val, size_t len) {
+        path.push(0);
+        sets[path.buf()];
+        path.pop();
+        sets.write(val, len);
+        return true;
+    }
+
+    bool value(uint32_t pp, uint32_t cp) {
+        uint32_t pe, ce;
+        if (!end(prev, plen, pp, pe) || !end(cur, clen, cp, ce)) return false;
+        if (pe - pp == ce - cp && !memcmp(prev + pp, cur + cp, pe - pp)) return true;
+
+        uint8_t hp = head(prev[pp]), hc = head(cur[cp]);
+        if (hp == BS_OBJ_OPEN && hc == BS_OBJ_OPEN) return object(pp, cp);
+        if (hp == BS_ARR_OPEN && hc == BS_ARR_OPEN) {
+            uint32_t np, nc;
+            if (!count(prev, plen, pp, np) || !count(cur, clen, cp, nc)) return false;
+            if (np == nc) return array(pp, cp);
+        }
+        return set(cur + cp, ce - cp);
+    }
+
+    // заменить объект целиком, отменив записанное по его ключам
+    bool replace(uint32_t cp, size_t base, size_t slen, size_t rlen) {
+        uint32_t ce;
+        pop(base);
+        return sets._resize(slen) && rms._resize(rlen) && end(cur, clen, cp, ce) && set(cur + cp, ce - cp);
+    }
+
+    bool object(uint32_t pp, uint32_t cp) {
+        size_t base = path.length();
+        size_t slen = sets.length(), rlen = rms.length();
+        bool sorted = prev[pp] == BS_SOBJ_OPEN;  // ключи в нём не добавить и не удалить
+        uint32_t hint = first(prev, plen, pp);
+        Parser p = parser(cur, clen, cp);
+        p.next();
+        Pair k;
+        bool err;
+        while (pair(p, k, err)) {  // изменённые и новые
+            uint32_t val;
+            bool ferr;
+            push(k.key, k.len);
+            if (find(prev, plen, pp, hint, k, val, ferr)) {
+                if (!value(val, k.val)) return false;
+            } else {
+                if (ferr) return false;
+                if (sorted) return replace(cp, base, slen, rlen);
+                if (!set(cur + k.val, (p._cur - cur) - k.val)) return false;
+            }
+            pop(base);
+        }
+        if (err) return false;
+
+        hint = first(cur, clen, cp);
+        p = parser(prev, plen, pp);
+        p.next();
+        while (pair(p, k, err)) {  // удалённые
+            uint32_t val;
+            bool ferr;
+            if (find(cur, clen, cp, hint, k, val, ferr)) continue;
+            if (ferr) return false;
+            if (sorted) return replace(cp, base, slen, rlen);
+            push(k.key, k.len);
+            rms.addStr(path.buf(), path.length());
+            pop(base);
+        }
+        return !err;
+    }
+
+    bool array(uint32_t pp, uint32_t cp) {
+        size_t base = path.length();
+        Parser a = parser(prev, plen, pp), b = parser(cur, clen, cp);
+        a.next();
+        b.next();
+        for (uint32_t i = 0;; i++) {
+            uint32_t va = a._cur - prev, vb = b._cur - cur;
+            if (!a.next() || !b.next()) return false;
+            if (a.isClose() || b.isClose()) return a.isClose() && b.isClose();
+            if (!a.skip() || !b.skip()) return false;
+
+            char num[11];
+            uint8_t len = _jsonUint(num + sizeof(num), i);
+            push(num + sizeof(num) - len, len);
+            if (!value(va, vb)) return false;
+            pop(base);
+        }
+    }
+
+    static bool apply(BSON& base, const uint8_t* patch, size_t len, const BSDictionary* dict) {
+        Parser p((uint8_t*)patch, len);
+        p.setDictionary(dict);
+        if (!p.next('[') || !p.next('{')) return false;
+
+        Editor e(base);
+        e.setDictionary(dict);
+        BSStack<char> path;
+        while (true) {
+            if (!p.next()) return false;
+            if (p.isClose()) break;
+            if (p._type != BSType::String) return false;
+            path.clear();
+            path.concat((const char*)p.toStr(), p._data);
+            path.push(0);
+
+            uint32_t pos = p._cur - patch;
+            if (!p.next() || (p.isOpen() && !p.skip())) return false;
+            size_t vlen = (p._cur - patch) - pos;
+
+            if (!path.buf()[0]) {  // корень
+                base.clear();
+                base.write(patch + pos, vlen);
+                continue;
+            }
+            e._tmp.clear();
+            e._key(path.buf());
+            size_t klen = e._tmp.length();
+            e._tmp.write(patch + pos, vlen);
+            if (!e._put(path.buf(), klen, true)) return false;
+        }
+
+        if (!p.next('[')) return false;
+        while (p.next()) {
+            if (p.isClose()) return p.next(']');
+            if (p._type != BSType::String) return false;
+            path.clear();
+            path.concat((const char*)p.toStr(), p._data);
+            path.push(0);
+            if (!e.remove(path.buf())) return false;
+        }
+        return false;
+    }
+};
+
+inline bool BSON::diff(const uint8_t* prev, size_t plen, const uint8_t* cur, size_t clen, BSON& patch, const BSDictionary* dict) {
+    if (!clen) return false;
+    BSON rms;
+    rms.setSized(patch._sized);
+    _Patch d{prev, cur, plen, clen, dict, patch, rms, BSStack<char>()};
+
+    // только один корневой документ в каждом пакете
+    uint32_t end;
+    if (plen && (!d.end(prev, plen, 0, end) || end != plen)) return false;
+    if (!d.end(cur, clen, 0, end) || end != clen) return false;
+
+    patch('[');
+    patch('{');
+    rms('[');
+    bool ok = plen ? d.value(0, 0) : d.set(cur, clen);
+    rms(']');
+    patch('}');
+    patch += rms;
+    patch(']');
+    return ok;
+}
+
+
+inline bool BSON::applyPatch(BSON& base, const uint8_t* patch, size_t len, const BSDictionary* dict) {
+    return _Patch::apply(base, patch, len, dict);
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "BSON.h"
+
+#if defined(BSON_USE_VECTOR) && !defined(__AVR__)
+#include <atomic>
+#include <utility>
+#include <vector>
+
+// ============== POOL ==============
+// пул сборщиков для многопоточных программ: сборщики сохраняют выделенную память между пакетами.
+// У каждого потока свой список, излишки уходят в общий список без блокировок
+class BSON::Pool {
+   public:
+    // взять сборщик: из списка потока, из общего списка или новый
+    static BSON get() {
+        Local& l = _local();
+        if (l.list.empty()) _take(l);
+        if (l.list.empty()) {
+            BSON b;
+            size_t reserve = _reserve().load(std::memory_order_relaxed);
+            if (reserve) b.reserve(reserve);
+            return b;
+        }
+        BSON b(std::move(l.list.back()));
+        l.list.pop_back();
+        return b;
+    }
+
+    // вернуть сборщик в пул. Он очищается, память сохраняется
+    static void put(BSON&& b) {
+        b.clear();
+        Local& l = _local();
+        if (l.list.size() < _limit().load(std::memory_order_relaxed)) l.list.push_back(std::move(b));
+        else _push(new Node{std::move(b), nullptr});
+    }
+
+    // сколько сборщиков держит каждый поток, остальные уходят в общий список [8]
+    static void setLocalLimit(size_t limit) {
+        _limit().store(limit, std::memory_order_relaxed);
+    }
+
+    // резерв памяти для новых сборщиков [0]
+    static void setReserve(size_t size) {
+        _reserve().store(size, std::memory_order_relaxed);
+    }
+
+   private:
+    struct Node {
+        BSON bson;
+        Node* next;
+    };
+
+    struct Local {
+        std::vector<BSON> list;
+
+        ~Local() {
+            for (BSON& b : list) _push(new Node{std::move(b), nullptr});
+        }
+    };
+
+    struct Global {
+        std::atomic<Node*> head{nullptr};
+
+        ~Global() {
+            Node* n = head.exchange(nullptr);
+            while (n) {
+                Node* next = n->next;
+                delete n;
+                n = next;
+            }
+        }
+    };
+
+    static Local& _local() {
+        static thread_local Local local;
+        return local;
+    }
+
+    static std::atomic<Node*>& _head() {
+        static Global global;
+        return global.head;
+    }
+
+    // настройки читаются из любых потоков, порядок с другими данными не нужен
+    static std::atomic<size_t>& _limit() {
+        static std::atomic<size_t> limit{8};
+        return limit;
+    }
+
+    static std::atomic<size_t>& _reserve() {
+        static std::atomic<size_t> reserve{0};
+        return reserve;
+    }
+
+    static void _push(Node* n) {
+        std::atomic<Node*>& head = _head();
+        n->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // забрать общий список целиком (без ABA), лишнее вернуть обратно
+    static void _take(Local& l) {
+        Node* n = _head().exchange(nullptr, std::memory_order_acquire);
+        size_t limit = _limit().load(std::memory_order_relaxed);
+        while (n) {
+            Node* next = n->next;
+            if (l.list.size() < limit || l.list.empty()) {
+                l.list.push_back(std::move(n->bson));
+                delete n;
+            } else {
+                _push(n);
+            }
+            n = next;
+        }
+    }
+};
+
+#endif
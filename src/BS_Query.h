@@ -0,0 +1,269 @@
+#pragma once
+#include "BSON.h"
+
+// ============== QUERY ==============
+// выборка по путям вида $.meta.id, $.items[*].sku, $.list[2], $.*: пути разбираются один раз,
+// обход идёт по парсеру без построения дерева, неподходящие контейнеры пропускаются целиком.
+// До 32 путей в одном запросе, при обходе память не выделяется
+class BSON::Query {
+   public:
+    Query() {}
+
+    // запрос из одного пути
+    Query(const char* path) {
+        add(path);
+    }
+
+    // добавить путь. Вернёт false при ошибке в пути или если путей больше 32
+    bool add(const char* path) {
+        if (_paths.length() >= 32) return false;
+        size_t steps = _steps.length(), keys = _keys.length();
+        Path pt{uint16_t(steps), 0};
+
+        bool ok = true;
+        if (*path == '$') path++;
+        while (*path && ok) {
+            Step s{Step::Key, 0, 0};
+            if (*path == '.') {
+                path++;
+                if (*path == '*') {
+                    s.kind = Step::AnyKey;
+                    path++;
+                } else {
+                    s.val = _keys.length();
+                    while (*path && *path != '.' && *path != '[') _keys.push(*path++);
+                    s.len = _keys.length() - s.val;
+                    ok = s.len;
+                }
+            } else if (*path == '[') {
+                path++;
+                s.kind = Step::Index;
+                if (*path == '*') {
+                    s.kind = Step::AnyIndex;
+                    path++;
+                } else {
+                    ok = *path >= '0' && *path <= '9';
+                    while (*path >= '0' && *path <= '9') s.val = s.val * 10 + *path++ - '0';
+                }
+                ok = ok && *path++ == ']';
+            } else {
+                ok = false;
+            }
+            _steps.push(s);
+            pt.len++;
+        }
+
+        if (!ok) {  // ошибка, откатить
+            while (_steps.length() > steps) _steps.pop();
+            while (_keys.length() > keys) _keys.pop();
+            return false;
+        }
+        _paths.push(pt);
+        if (pt.len > _depth) {
+            _depth = pt.len;
+            _pend.reserve(_depth + 1);
+        }
+        return true;
+    }
+
+    // удалить все пути
+    void clear() {
+        _steps.clear();
+        _keys.clear();
+        _paths.clear();
+        _depth = 0;
+    }
+
+    // количество путей
+    uint8_t length() const {
+        return _paths.length();
+    }
+
+    // словарь для ключей-кодов в пакетах
+    void setDictionary(const BSDictionary* dict) {
+        _dict = dict;
+    }
+
+    // обойти пакет, f(Parser& value, uint8_t path) на каждое найденное значение. Вернёт false при ошибке в пакете
+    template <typename F>
+    bool run(uint8_t* bson, size_t len, F f) {
+        _Run<F> r{*this, f};
+        return _root(bson, len, r);
+    }
+
+    // обойти пакет, f(Parser& value, uint8_t path) на каждое найденное значение
+    template <typename F>
+    bool run(BSON& bson, F f) {
+        return run(bson.buf(), bson.length(), f);
+    }
+
+    // дописать в out пакет только с выбранными значениями, сохраняя их путь
+    bool project(uint8_t* bson, size_t len, BSON& out) {
+        _pend.clear();
+        _Project pr{*this, out};
+        return _root(bson, len, pr);
+    }
+
+    // дописать в out пакет только с выбранными значениями, сохраняя их путь
+    bool project(BSON& bson, BSON& out) {
+        return project(bson.buf(), bson.length(), out);
+    }
+
+   private:
+    struct Step {
+        enum : uint8_t {
+            Key,
+            AnyKey,
+            Index,
+            AnyIndex,
+        } kind;
+        uint16_t len;  // длина ключа
+        uint32_t val;  // позиция ключа в _keys или индекс
+    };
+    struct Path {
+        uint16_t start, len;
+    };
+    struct Pend {
+        const uint8_t* key;
+        uint16_t klen;
+        bool obj, open;
+    };
+
+    BSStack<Step> _steps;
+    BSStack<char> _keys;
+    BSStack<Path> _paths;
+    BSStack<Pend> _pend;
+    const BSDictionary* _dict = nullptr;
+    uint16_t _depth = 0;
+
+    // paths - маска путей, которые выбрали значение. nested - искать более длинные пути внутри выбранного
+    template <typename F>
+    struct _Run {
+        static const bool nested = true;
+        Query& q;
+        F& f;
+
+        void match(const uint8_t*, const uint8_t* val, const uint8_t* end, uint32_t paths) {
+            for (uint8_t i = 0; paths; i++, paths >>= 1) {
+                if (!(paths & 1)) continue;
+                Parser p((uint8_t*)val, end - val);
+                p.setDictionary(q._dict);
+                f(p, i);
+            }
+        }
+        void enter(const uint8_t*, const uint8_t*, bool) {}
+        void leave() {}
+    };
+
+    struct _Project {
+        static const bool nested = false;  // выбранное значение уже целиком в пакете
+        Query& q;
+        BSON& out;
+
+        void match(const uint8_t* key, const uint8_t*, const uint8_t* end, uint32_t) {
+            for (size_t i = 0; i < q._pend.length(); i++) {
+                Pend& pd = q._pend.buf()[i];
+                if (pd.open) continue;
+                out.write(pd.key, pd.klen);
+                out(pd.obj ? '{' : '[');
+                pd.open = true;
+            }
+            out.write(key, end - key);
+        }
+        void enter(const uint8_t* key, const uint8_t* val, bool obj) {
+            q._pend.push(Pend{key, uint16_t(val - key), obj, false});
+        }
+        void leave() {
+            Pend pd = q._pend.pop();
+            if (pd.open) out(pd.obj ? '}' : ']');
+        }
+    };
+
+    template <typename V>
+    bool _root(uint8_t* bson, size_t len, V& v) {
+        Parser p(bson, len);
+        p.setDictionary(_dict);
+        if (!p.next()) return false;
+
+        uint32_t active = 0, hit = 0;
+        for (uint8_t i = 0; i < _paths.length(); i++) {
+            (_paths.buf()[i].len ? active : hit) |= 1ul << i;  // $ - весь пакет
+        }
+        bool descend = active && p.isOpen() && (!hit || V::nested);
+        if (hit && !_match(p, bson, bson, hit, descend, v)) return false;
+        if (!descend) return true;
+        v.enter(bson, bson, p.isObject());
+        if (!_cont(p, active, 0, v)) return false;
+        v.leave();
+        return true;
+    }
+
+    // p стоит на открытом контейнере, active - пути, у которых шаг depth ещё не пройден
+    template <typename V>
+    bool _cont(Parser& p, uint32_t active, uint16_t depth, V& v) {
+        bool obj = p.isObject();
+        for (uint32_t i = 0;; i++) {
+            const uint8_t* key = p._cur;
+            if (!p.next()) return false;
+            if (p.isClose()) return true;
+
+            const uint8_t* val = key;
+            const char* kstr = nullptr;
+            uint16_t klen = 0;
+            if (obj) {
+                if (p._type == BSType::Container) return false;
+                if (p._type == BSType::String) {  // ключи-коды без словаря подходят только под .*
+                    kstr = (const char*)p.toStr();
+                    klen = p._data;
+                }
+                val = p._cur;
+                if (!p.next()) return false;
+            }
+
+            uint32_t hit = 0, deeper = 0;
+            for (uint8_t j = 0; j < _paths.length(); j++) {
+                if (!(active & (1ul << j))) continue;
+                const Path& pt = _paths.buf()[j];
+                const Step& s = _steps.buf()[pt.start + depth];
+                bool m;
+                switch (s.kind) {
+                    case Step::Key: m = kstr && s.len == klen && !memcmp(_keys.buf() + s.val, kstr, klen); break;
+                    case Step::AnyKey: m = obj; break;
+                    case Step::Index: m = !obj && s.val == i; break;
+                    default: m = !obj; break;
+                }
+                if (m) (depth + 1 == pt.len ? hit : deeper) |= 1ul << j;
+            }
+
+            bool descend = deeper && p.isOpen() && (!hit || V::nested);
+            if (hit) {
+                if (!_match(p, key, val, hit, descend, v)) return false;
+            } else if (!descend && p.isOpen() && !p.skip()) {
+                return false;
+            }
+            if (descend) {
+                v.enter(key, val, p.isObject());
+                if (!_cont(p, deeper, depth + 1, v)) return false;
+                v.leave();
+            }
+        }
+    }
+
+    // значение выбрано путями hit. descend - парсер остаётся на открытии контейнера для обхода вглубь
+    template <typename V>
+    bool _match(Parser& p, const uint8_t* key, const uint8_t* val, uint32_t hit, bool descend, V& v) {
+        const uint8_t* end = p._cur;
+        if (p.isOpen()) {
+            if (descend) {
+                Parser e = p;
+                if (!e.skip()) return false;
+                end = e._cur;
+            } else {
+                if (!p.skip()) return false;
+                end = p._cur;
+            }
+        }
+        v.match(key, val, end, hit);
+        return true;
+    }
+};
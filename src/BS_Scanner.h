@@ -0,0 +1,266 @@
+#pragma once
+#include "BSON.h"
+
+#ifndef ARDUINO
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ============== SCANNER ==============
+// параллельный обход больших данных: пакетов подряд, элементов массива верхнего уровня или журнала.
+// Предварительный проход режет данные на куски по границам пакетов: контейнеры с размером пропускаются по размеру
+// без разбора, журнал режется по маркерам без прохода. Пакеты без размера проходятся в одном потоке по всем блокам,
+// это ограничивает масштабирование. Куски разбирают потоки: освободившийся поток берёт следующий кусок.
+// Пула потоков нет намеренно: потоки создаются на каждый вызов и завершаются с ним (десятки мкс на поток),
+// для данных от мегабайта это незаметно. Для частых обходов мелких данных Scanner не подходит
+class BSON::Scanner {
+   public:
+    // threads = 0 - по количеству ядер
+    Scanner(unsigned threads = 0) {
+        setThreads(threads);
+    }
+
+    // количество потоков, 0 - по количеству ядер
+    void setThreads(unsigned threads) {
+        if (!threads) threads = std::thread::hardware_concurrency();
+        _threads = threads ? threads : 1;
+    }
+
+    // примерный размер куска в байтах (по умолчанию 1 МБ)
+    void setChunk(size_t bytes) {
+        _chunk = bytes ? bytes : 1;
+    }
+
+    // словарь для парсеров
+    void setDictionary(const BSDictionary* dict) {
+        _dict = dict;
+    }
+
+    // пакеты подряд. f(Parser& p, size_t index) вызывается из разных потоков. Вернёт false при ошибке в данных
+    template <typename F>
+    bool records(const uint8_t* data, size_t len, F f) {
+        return _each(Kind::Records, data, len, f);
+    }
+
+    // пакеты подряд. Результаты f(p, index) передаются в merge(R& res) по порядку пакетов или по готовности
+    template <typename F, typename M>
+    bool records(const uint8_t* data, size_t len, F f, M merge, bool ordered = true) {
+        return _map(Kind::Records, data, len, f, merge, ordered);
+    }
+
+    // элементы массива верхнего уровня, index - номер элемента
+    template <typename F>
+    bool elements(const uint8_t* data, size_t len, F f) {
+        return _each(Kind::Elements, data, len, f);
+    }
+
+    // элементы массива верхнего уровня с результатами
+    template <typename F, typename M>
+    bool elements(const uint8_t* data, size_t len, F f, M merge, bool ordered = true) {
+        return _map(Kind::Elements, data, len, f, merge, ordered);
+    }
+
+#ifdef BS_LOG
+    // журнал LogWriter, index - позиция пакета в журнале
+    template <typename F>
+    bool log(const uint8_t* data, size_t len, F f) {
+        return _each(Kind::Log, data, len, f);
+    }
+
+    // журнал LogWriter с результатами
+    template <typename F, typename M>
+    bool log(const uint8_t* data, size_t len, F f, M merge, bool ordered = true) {
+        return _map(Kind::Log, data, len, f, merge, ordered);
+    }
+
+    // пропущено испорченных участков журнала при последнем обходе
+    size_t errors() const {
+        return _errors;
+    }
+#endif
+
+   private:
+    enum class Kind : uint8_t {
+        Records,
+        Elements,
+        Log,
+    };
+
+    struct Chunk {
+        size_t begin, end, index;
+    };
+
+    // результат обработчика, не std::vector<bool>
+    template <typename R>
+    struct Res {
+        R v;
+    };
+
+    const BSDictionary* _dict = nullptr;
+    size_t _chunk = 1ul << 20;
+    unsigned _threads = 1;
+    std::atomic<size_t> _errors{0};
+
+    // граница куска: в начале пакета
+    bool _split(Kind kind, const uint8_t* data, size_t len, std::vector<Chunk>& chunks) {
+#ifdef BS_LOG
+        if (kind == Kind::Log) return _splitLog(data, len, chunks);
+#endif
+        const uint8_t* p = data;
+        const uint8_t* end = data + len;
+        if (kind == Kind::Elements) {
+            Parser a((uint8_t*)data, len);
+            if (!a.next('[')) return false;
+            p = a._cur;
+        }
+
+        size_t begin = p - data, index = 0, count = 0;
+        while (p < end) {
+            if (kind == Kind::Elements && *p == BS_ARR_CLOSE) break;
+            p = _skip(p, end);
+            if (!p) return false;
+            count++;
+
+            size_t pos = p - data;
+            if (pos - begin >= _chunk) {
+                chunks.push_back(Chunk{begin, pos, index});
+                begin = pos;
+                index += count;
+                count = 0;
+            }
+        }
+        if (kind == Kind::Elements && p == end) return false;  // нет закрытия
+        if (count) chunks.push_back(Chunk{begin, size_t(p - data), index});
+        return true;
+    }
+
+    // конец пакета с позиции p или nullptr при ошибке. Контейнер с размером - по размеру, иначе обход парсером
+    static const uint8_t* _skip(const uint8_t* p, const uint8_t* end) {
+        uint8_t h = *p;
+        if ((h & 0xe0) == BS_CONTAINER && (h & (BS_CONT_OPEN | BS_CONT_CLOSE | BS_CONT_SIZED)) == (BS_CONT_OPEN | BS_CONT_SIZED)) {
+            uint32_t size;
+            if (size_t(end - p) < 2 + BS_CONT_SIZE_LEN) return nullptr;
+            memcpy(&size, p + 1, BS_CONT_SIZE_LEN);
+            if (size > size_t(end - p) - 2 - BS_CONT_SIZE_LEN) return nullptr;
+            p += 1 + BS_CONT_SIZE_LEN + size;
+            uint8_t close = BS_CONTAINER | BS_CONT_CLOSE | ((h & BS_CONT_OBJ) ? BS_CONT_OBJ : BS_CONT_ARR);
+            return *p == close ? p + 1 : nullptr;
+        }
+        Parser w((uint8_t*)p, end - p);
+        if (!w.next() || w.isClose() || (w.isOpen() && !w.skip())) return nullptr;
+        return w._cur;
+    }
+
+#ifdef BS_LOG
+    // границы по маркерам, маркер принимается, если за ним корректная запись
+    bool _splitLog(const uint8_t* data, size_t len, std::vector<Chunk>& chunks) {
+        size_t begin = 0;
+        for (size_t pos = _chunk; pos < len; pos += _chunk) {
+            const uint8_t* m = data + pos;
+            while ((m = (const uint8_t*)memmem(m, data + len - m, BS_LOG_MARKER, BS_LOG_MARKER_LEN))) {
+                LogReader r(m, data + len - m);
+                if (r.next() && !r.errors()) break;
+                m++;
+            }
+            if (!m) break;
+            chunks.push_back(Chunk{begin, size_t(m - data), begin});
+            begin = m - data;
+            pos = begin;
+        }
+        if (begin < len) chunks.push_back(Chunk{begin, len, begin});
+        return true;
+    }
+#endif
+
+    // обход пакетов куска
+    template <typename G>
+    bool _walk(Kind kind, const uint8_t* data, const Chunk& c, G g) {
+#ifdef BS_LOG
+        if (kind == Kind::Log) {
+            LogReader r(data + c.begin, c.end - c.begin);
+            while (r.next()) {
+                Parser p = r.parser();
+                p.setDictionary(_dict);
+                g(p, c.begin + r.offset());
+            }
+            _errors += r.errors();
+            return true;
+        }
+#endif
+        const uint8_t* s = data + c.begin;
+        const uint8_t* end = data + c.end;
+        for (size_t i = c.index; s < end; i++) {
+            const uint8_t* e = _skip(s, end);
+            if (!e) return false;
+            Parser p((uint8_t*)s, e - s);
+            p.setDictionary(_dict);
+            g(p, i);
+            s = e;
+        }
+        return true;
+    }
+
+    // v(chunk, номер куска) в потоках
+    template <typename V>
+    bool _run(const std::vector<Chunk>& chunks, V v) {
+        std::atomic<size_t> next{0};
+        std::atomic<bool> ok{true};
+        auto work = [&]() {
+            size_t i;
+            while (ok && (i = next++) < chunks.size()) {
+                if (!v(chunks[i], i)) ok = false;
+            }
+        };
+
+        unsigned n = _threads < chunks.size() ? _threads : chunks.size();
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < n; i++) threads.emplace_back(work);
+        work();
+        for (std::thread& t : threads) t.join();
+        return ok;
+    }
+
+    template <typename F>
+    bool _each(Kind kind, const uint8_t* data, size_t len, F& f) {
+        std::vector<Chunk> chunks;
+        _errors = 0;
+        if (!_split(kind, data, len, chunks)) return false;
+        return _run(chunks, [&](const Chunk& c, size_t) {
+            return _walk(kind, data, c, f);
+        });
+    }
+
+    template <typename F, typename M>
+    bool _map(Kind kind, const uint8_t* data, size_t len, F& f, M& merge, bool ordered) {
+        typedef decltype(f(*(Parser*)nullptr, size_t())) R;
+        std::vector<Chunk> chunks;
+        _errors = 0;
+        if (!_split(kind, data, len, chunks)) return false;
+
+        std::vector<std::vector<Res<R>>> results(ordered ? chunks.size() : 0);
+        std::vector<uint8_t> done(chunks.size());
+        size_t head = 0;
+        std::mutex mx;
+
+        return _run(chunks, [&](const Chunk& c, size_t ci) {
+            std::vector<Res<R>> out;
+            if (!_walk(kind, data, c, [&](Parser& p, size_t i) { out.push_back(Res<R>{f(p, i)}); })) return false;
+
+            std::lock_guard<std::mutex> lock(mx);
+            if (!ordered) {
+                for (Res<R>& r : out) merge(r.v);
+                return true;
+            }
+            results[ci] = std::move(out);
+            done[ci] = 1;
+            for (; head < chunks.size() && done[head]; head++) {  // готовые куски по порядку
+                for (Res<R>& r : results[head]) merge(r.v);
+                std::vector<Res<R>>().swap(results[head]);
+            }
+            return true;
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,243 @@
+#pragma once
+#include <inttypes.h>
+#include <string.h>
+
+#include "BS_MACRO.h"
+
+// ============== STATS ==============
+// счётчики сборщика и парсера для профилирования. Включаются дефайном BSON_STATS перед подключением библиотеки,
+// без него не занимают памяти и не выполняются. Счётчики у каждого объекта свои, на ПК они при удалении объекта
+// добавляются в общие счётчики процесса BSStats::global() (атомарно, без упорядочивания)
+#ifdef BSON_STATS
+#define BS_STAT(x) x
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <atomic>
+#include <chrono>
+#define BS_STATS_GLOBAL
+#endif
+#else
+#define BS_STAT(x)
+#endif
+
+struct BSStats {
+    // причина ошибки парсера
+    enum Error : uint8_t {
+        Truncated,  // пакет обрывается
+        Header,     // некорректный заголовок блока
+        Container,  // закрытие не совпадает с открытием или размером
+        Table,      // испорчена таблица отсортированного объекта
+        Key,        // ключ объекта не строка
+        ErrorCount,
+    };
+
+#ifdef BSON_STATS
+#ifdef __AVR__
+    typedef uint32_t Count;
+#else
+    typedef uint64_t Count;
+#endif
+
+    // индекс типа в tokens и bytes: BS_TYPE >> 5, TypedArray - последний
+    static const uint8_t TypeCount = 9;
+
+    Count allocs = 0;                // выделений памяти буфером сборщика
+    Count grown = 0;                 // байт добавлено к буферу при выделениях
+    Count tokens[TypeCount] = {};    // блоков по типам
+    Count bytes[TypeCount] = {};     // байт по типам, с заголовками
+    uint16_t maxDepth = 0;           // наибольшая вложенность контейнеров
+    Count errors[ErrorCount] = {};   // ошибок парсера по причинам
+    Count stringifies = 0;           // вызовов stringify
+    Count stringifyNs = 0;           // время в stringify, нс (на Arduino с шагом micros)
+
+    static uint8_t index(uint8_t type) {
+        return type == BS_TYPED_ARR ? TypeCount - 1 : (type >> 5);
+    }
+
+    // блоков типа [BSType]
+    template <typename T>
+    Count tokensOf(T type) const {
+        return tokens[index(uint8_t(type))];
+    }
+
+    // байт типа [BSType]
+    template <typename T>
+    Count bytesOf(T type) const {
+        return bytes[index(uint8_t(type))];
+    }
+
+    // всего ошибок парсера
+    Count errorsTotal() const {
+        Count n = 0;
+        for (uint8_t i = 0; i < ErrorCount; i++) n += errors[i];
+        return n;
+    }
+
+    // прибавить другие счётчики, вложенность - наибольшая
+    void add(const BSStats& s) {
+        allocs += s.allocs;
+        grown += s.grown;
+        for (uint8_t i = 0; i < TypeCount; i++) {
+            tokens[i] += s.tokens[i];
+            bytes[i] += s.bytes[i];
+        }
+        if (s.maxDepth > maxDepth) maxDepth = s.maxDepth;
+        for (uint8_t i = 0; i < ErrorCount; i++) errors[i] += s.errors[i];
+        stringifies += s.stringifies;
+        stringifyNs += s.stringifyNs;
+    }
+
+    // обнулить
+    void clear() {
+        *this = BSStats();
+    }
+
+#ifdef BS_STATS_GLOBAL
+    // снимок общих счётчиков процесса
+    static BSStats global() {
+        BSStats s;
+        _Global& g = _global();
+        s.allocs = g.allocs.load(std::memory_order_relaxed);
+        s.grown = g.grown.load(std::memory_order_relaxed);
+        for (uint8_t i = 0; i < TypeCount; i++) {
+            s.tokens[i] = g.tokens[i].load(std::memory_order_relaxed);
+            s.bytes[i] = g.bytes[i].load(std::memory_order_relaxed);
+        }
+        s.maxDepth = g.maxDepth.load(std::memory_order_relaxed);
+        for (uint8_t i = 0; i < ErrorCount; i++) s.errors[i] = g.errors[i].load(std::memory_order_relaxed);
+        s.stringifies = g.stringifies.load(std::memory_order_relaxed);
+        s.stringifyNs = g.stringifyNs.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // добавить счётчики в общие
+    static void merge(const BSStats& s) {
+        _Global& g = _global();
+        _add(g.allocs, s.allocs);
+        _add(g.grown, s.grown);
+        for (uint8_t i = 0; i < TypeCount; i++) {
+            _add(g.tokens[i], s.tokens[i]);
+            _add(g.bytes[i], s.bytes[i]);
+        }
+        uint16_t d = g.maxDepth.load(std::memory_order_relaxed);
+        while (s.maxDepth > d && !g.maxDepth.compare_exchange_weak(d, s.maxDepth, std::memory_order_relaxed));
+        for (uint8_t i = 0; i < ErrorCount; i++) _add(g.errors[i], s.errors[i]);
+        _add(g.stringifies, s.stringifies);
+        _add(g.stringifyNs, s.stringifyNs);
+    }
+
+    // обнулить общие счётчики
+    static void clearGlobal() {
+        _global().clear();
+    }
+#endif
+
+    // счётчики объекта: копия начинает с нуля, при удалении и reset() счётчики уходят в общие
+    struct Local;
+
+    // замер времени stringify до конца блока. nullptr - сразу в общие счётчики
+    class Timer {
+       public:
+        Timer(BSStats* st) : _st(st), _t0(_now()) {}
+        ~Timer() {
+            BSStats s;
+            BSStats* st = _st ? _st : &s;
+            st->stringifies++;
+            st->stringifyNs += _now() - _t0;
+#ifdef BS_STATS_GLOBAL
+            if (!_st) merge(s);
+#endif
+        }
+
+       private:
+        BSStats* _st;
+        Count _t0;
+
+        static Count _now() {
+#ifdef ARDUINO
+            return Count(micros()) * 1000;
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+    };
+
+   private:
+#ifdef BS_STATS_GLOBAL
+    struct _Global {
+        std::atomic<Count> allocs{0}, grown{0};
+        std::atomic<Count> tokens[TypeCount], bytes[TypeCount];
+        std::atomic<uint16_t> maxDepth{0};
+        std::atomic<Count> errors[ErrorCount];
+        std::atomic<Count> stringifies{0}, stringifyNs{0};
+
+        _Global() {
+            clear();
+        }
+
+        void clear() {
+            allocs = 0;
+            grown = 0;
+            for (uint8_t i = 0; i < TypeCount; i++) tokens[i] = bytes[i] = 0;
+            maxDepth = 0;
+            for (uint8_t i = 0; i < ErrorCount; i++) errors[i] = 0;
+            stringifies = 0;
+            stringifyNs = 0;
+        }
+    };
+
+    static _Global& _global() {
+        static _Global g;
+        return g;
+    }
+
+    static void _add(std::atomic<Count>& c, Count v) {
+        if (v) c.fetch_add(v, std::memory_order_relaxed);
+    }
+#endif
+#endif
+};
+
+#ifdef BSON_STATS
+struct BSStats::Local : BSStats {
+    uint16_t depth = 0;
+
+    Local() {}
+    Local(const Local&) : BSStats() {}
+    Local& operator=(const Local&) {
+        return *this;
+    }
+    ~Local() {
+        flush();
+    }
+
+    void reset() {
+        flush();
+        clear();
+    }
+
+    void flush() {
+#ifdef BS_STATS_GLOBAL
+        merge(*this);
+#endif
+    }
+
+    void open() {
+        if (++depth > maxDepth) maxDepth = depth;
+    }
+    void close() {
+        if (depth) depth--;
+    }
+    void token(uint8_t type, size_t len) {
+        uint8_t i = index(type);
+        tokens[i]++;
+        bytes[i] += len;
+    }
+    void grow(size_t len) {
+        allocs++;
+        grown += len;
+    }
+};
+#endif
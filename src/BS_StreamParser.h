@@ -0,0 +1,344 @@
+#pragma once
+#include "BSON.h"
+
+#ifndef __AVR__
+#include <functional>
+#endif
+
+// ============== STREAM PARSER ==============
+// потоковый парсер BSON: принимает пакет частями через feed() и вызывает обработчик на каждый блок.
+// Строки и бинарные данные отдаются кусками прямо из входного буфера, без копирования
+class BSON::StreamParser {
+   public:
+#ifdef __AVR__
+    typedef void (*Callback)(StreamParser& p);
+#else
+    typedef std::function<void(StreamParser& p)> Callback;
+#endif
+
+    StreamParser() {}
+    StreamParser(Callback cb) : _cb(cb) {}
+
+    // подключить обработчик блоков
+    void attach(Callback cb) {
+        _cb = cb;
+    }
+
+    // начать заново
+    void reset() {
+        _state = State::Head;
+        _type = BSType::Error;
+        _done = true;
+    }
+
+    // передать часть пакета. Вернёт false при ошибке в пакете
+    bool feed(const uint8_t* data, size_t len) {
+        if (_state == State::Error) return false;
+        const uint8_t* end = data + len;
+
+        while (data < end) {
+            switch (_state) {
+                case State::Head:
+                    _head = *data++;
+                    _type = (BSType)BS_TYPE(_head);
+                    _got = 0;
+                    _need = 0;
+                    _done = false;
+
+                    switch (_type) {
+                        case BSType::Container:
+                            if (_head == BS_TYPED_ARR) {
+                                _type = BSType::TypedArray;
+                                _need = 1;
+                            } else if (_head == BS_SOBJ_OPEN) {
+                                _need = BS_CONT_SIZE_LEN + BS_SOBJ_CNT_LEN;
+                            } else if (_head & BS_CONT_SIZED) {
+                                _need = BS_CONT_SIZE_LEN;
+                            }
+                            break;
+                        case BSType::String:
+                        case BSType::Binary:
+                        case BSType::Code:
+                            _need = 1;
+                            break;
+                        case BSType::Integer:
+                            _need = BS_SIZE(_head);
+                            if (_need > 8) return _abort();
+                            break;
+                        case BSType::Float:
+                            _need = (_head & BS_FLOAT_EXT) ? 1 : BS_FLOAT_SIZE;
+                            break;
+                        case BSType::Null:
+                            if (_head == BS_STR_EXT || _head == BS_BIN_EXT) {
+                                _type = (_head == BS_STR_EXT) ? BSType::String : BSType::Binary;
+                                _need = BS_EXT_LEN;
+                            }
+                            break;
+                        default:
+                            break;
+                    }
+                    if (_need) _state = State::Collect;
+                    else _emit();
+                    break;
+
+                case State::Collect: {
+                    size_t n = _need - _got;
+                    if (n > size_t(end - data)) n = end - data;
+                    memcpy(_buf + _got, data, n);
+                    _got += n;
+                    data += n;
+                    if (_got < _need) break;
+
+                    if (_type == BSType::Float && (_head & BS_FLOAT_EXT) && _need == 1) {  // байт формы, затем данные
+                        int8_t size = BSFloat::extSize(_buf[0]);
+                        if (size < 0) return _abort();
+                        _need += size;
+                        if (_got < _need) break;
+                    }
+
+                    if (_type == BSType::TypedArray && _need == 1) {  // тип элемента, затем количество
+                        uint8_t size = BS_TA_SIZE(_buf[0]);
+                        uint8_t cl = BS_TA_CNT_LEN(_buf[0]);
+                        if (cl > 4 || (size != 1 && size != 2 && size != 4 && size != 8) || ((_buf[0] & BS_TA_FLOAT) && size < 4)) return _abort();
+                        _need += cl;
+                        break;
+                    }
+
+                    if (_head == BS_SOBJ_OPEN) {  // отсортированный объект: таблица смещений пропускается
+                        uint16_t cnt;
+                        memcpy(&cnt, _buf + BS_CONT_SIZE_LEN, BS_SOBJ_CNT_LEN);
+                        _head = BS_OBJ_OPEN | BS_CONT_SIZED;
+                        _left = uint32_t(cnt) * BS_SOBJ_OFFS_LEN;
+                        if (_left) {
+                            _state = State::Table;
+                            break;
+                        }
+                    }
+
+                    if (_type == BSType::String || _type == BSType::Binary || _type == BSType::TypedArray) {
+                        if (_type == BSType::TypedArray) {
+                            uint32_t n = 0;
+                            memcpy(&n, _buf + 1, _need - 1);
+                            uint64_t len = uint64_t(n) * BS_TA_SIZE(_buf[0]);
+                            if (len > BS_MAX_EXT_LEN) return _abort();  // длина не помещается в 4 байта
+                            _length = len;
+                        } else if (BS_TYPE(_head) == BS_NULL) {
+                            memcpy(&_length, _buf, BS_EXT_LEN);
+                        } else {
+                            _length = BS_D16_MERGE(BS_DATA(_head), _buf[0]);
+                        }
+                        _left = _length;
+                        _chunk = data;
+                        _chunkLen = 0;
+                        if (_left) _state = State::Payload;
+                        else _emit();
+                    } else {
+                        _emit();
+                    }
+                } break;
+
+                case State::Payload: {
+                    size_t n = _left;
+                    if (n > size_t(end - data)) n = end - data;
+                    _chunk = data;
+                    _chunkLen = n;
+                    _left -= n;
+                    data += n;
+                    if (!_left) _state = State::Head;
+                    _call();
+                } break;
+
+                case State::Table: {
+                    size_t n = _left;
+                    if (n > size_t(end - data)) n = end - data;
+                    _left -= n;
+                    data += n;
+                    if (!_left) _emit();
+                } break;
+
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // пакет принят полностью (нет недополученного блока)
+    bool isDone() const {
+        return _done && _state == State::Head;
+    }
+
+    // ============ CHECK ============
+
+    // получить тип блока
+    BSType getType() const {
+        return _type;
+    }
+
+    // контейнер - объект [Container]
+    bool isObject() const {
+        return (_type == BSType::Container) ? (_head & BS_CONT_OBJ) : false;
+    }
+
+    // контейнер - массив [Container]
+    bool isArray() const {
+        return (_type == BSType::Container) ? (_head & BS_CONT_ARR) : false;
+    }
+
+    // контейнер открыт [Container]
+    bool isOpen() const {
+        return (_type == BSType::Container) ? (_head & BS_CONT_OPEN) : false;
+    }
+
+    // контейнер закрыт [Container]
+    bool isClose() const {
+        return (_type == BSType::Container) ? (_head & BS_CONT_CLOSE) : false;
+    }
+
+    // полная длина в байтах [String, Binary, Integer], количество элементов [TypedArray]
+    size_t length() const {
+        switch (_type) {
+            case BSType::String:
+            case BSType::Binary:
+                return _length;
+
+            case BSType::TypedArray:
+                return _length / BS_TA_SIZE(_buf[0]);
+
+            case BSType::Integer:
+                return BS_SIZE(_head);
+
+            default:
+                return 0;
+        }
+    }
+
+    // число отрицательное [Integer]
+    bool isNegative() const {
+        return (_type == BSType::Integer) ? BS_NEGATIVE(_head) : false;
+    }
+
+    // тип элемента BS_TA_... [TypedArray]
+    uint8_t elementType() const {
+        return (_type == BSType::TypedArray) ? BS_TA_ELEM(_buf[0]) : 0;
+    }
+
+    // ============ CHUNK ============
+
+    // кусок данных [String, Binary, TypedArray]
+    const uint8_t* chunk() const {
+        return _chunk;
+    }
+
+    // длина куска [String, Binary, TypedArray]
+    size_t chunkLength() const {
+        return _chunkLen;
+    }
+
+    // позиция куска в данных [String, Binary, TypedArray]
+    size_t chunkOffset() const {
+        return _length - _left - _chunkLen;
+    }
+
+    // первый кусок [String, Binary, TypedArray]
+    bool isFirstChunk() const {
+        return chunkOffset() == 0;
+    }
+
+    // последний кусок [String, Binary, TypedArray]
+    bool isLastChunk() const {
+        return _left == 0;
+    }
+
+    // ============ EXPORT ============
+
+    // в код [Code]
+    template <typename T>
+    T toCode() const {
+        return (_type == BSType::Code) ? T(BS_D16_MERGE(BS_DATA(_head), _buf[0])) : T(0);
+    }
+
+    // в bool [Boolean]
+    bool toBool() const {
+        return (_type == BSType::Boolean) ? BS_BOOLV(_head) : false;
+    }
+
+    // в int [Integer]
+    int32_t toInt() const {
+        return _toInt<int32_t>();
+    }
+
+    // в uint [Integer]
+    uint32_t toUint() const {
+        return toInt();
+    }
+
+    // в int [Integer]
+    int64_t toInt64() const {
+        return _toInt<int64_t>();
+    }
+
+    // в uint [Integer]
+    uint64_t toUint64() const {
+        return toInt64();
+    }
+
+    // в float [Float]
+    float toFloat() const {
+        return toDouble();
+    }
+
+    // в double [Float]
+    double toDouble() const {
+        return (_type == BSType::Float) ? BSFloat::read(_head, _buf) : 0;
+    }
+
+   private:
+    enum class State : uint8_t {
+        Head,
+        Collect,
+        Payload,
+        Table,
+        Error,
+    };
+
+    Callback _cb = nullptr;
+    const uint8_t* _chunk = nullptr;
+    size_t _chunkLen = 0;
+    uint32_t _length = 0;
+    uint32_t _left = 0;
+    uint8_t _buf[9];
+    uint8_t _head = 0;
+    uint8_t _need = 0;
+    uint8_t _got = 0;
+    BSType _type = BSType::Error;
+    State _state = State::Head;
+    bool _done = true;
+
+    void _emit() {
+        _state = State::Head;
+        _call();
+    }
+
+    void _call() {
+        if (_state == State::Head) _done = true;
+        if (_cb) _cb(*this);
+    }
+
+    bool _abort() {
+        _type = BSType::Error;
+        _state = State::Error;
+        if (_cb) _cb(*this);
+        return false;
+    }
+
+    template <typename T>
+    T _toInt() const {
+        if (_type != BSType::Integer) return 0;
+
+        T v = 0;
+        uint8_t size = BS_SIZE(_head);
+        memcpy(&v, _buf, size > sizeof(T) ? sizeof(T) : size);
+        return BS_NEGATIVE(_head) ? -v : v;
+    }
+};
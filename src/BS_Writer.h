@@ -0,0 +1,149 @@
+#pragma once
+#include "BSON.h"
+
+#ifndef __AVR__
+#include <functional>
+#endif
+
+#if !defined(ARDUINO) && (defined(__unix__) || defined(__APPLE__))
+#include <errno.h>
+#include <unistd.h>
+#define BS_WRITER_FD
+#endif
+
+// ============== WRITER ==============
+// потоковая сборка BSON в буфер фиксированного размера. Заполненный буфер отправляется
+// в обработчик, Print или файловый дескриптор, память не растёт с размером пакета
+class BSON::Writer : public BSBuilder<BSON::Writer> {
+    typedef BSBuilder<BSON::Writer> BD;
+    friend class BSBuilder<BSON::Writer>;
+
+   public:
+    using BD::operator=;
+
+#ifdef __AVR__
+    typedef void (*Callback)(const uint8_t* data, size_t len);
+#else
+    typedef std::function<void(const uint8_t* data, size_t len)> Callback;
+#endif
+
+    // буфер buf размером size > 0, отправка в обработчик
+    Writer(uint8_t* buf, size_t size, Callback cb) : _buf(buf), _size(size), _cb(cb) {}
+
+#ifdef ARDUINO
+    // буфер buf размером size > 0, отправка в Print
+    Writer(uint8_t* buf, size_t size, Print& p) : _buf(buf), _size(size), _print(&p) {}
+#endif
+
+#ifdef BS_WRITER_FD
+    // буфер buf размером size > 0, отправка в файловый дескриптор
+    Writer(uint8_t* buf, size_t size, int fd) : _buf(buf), _size(size), _fd(fd) {}
+#endif
+
+    // записать байт
+    void push(uint8_t v) {
+        if (_len == _size) flush();
+        _buf[_len++] = v;
+    }
+
+    // записать данные. Крупные данные отправляются напрямую, минуя буфер
+    size_t write(const void* data, size_t len, bool pgm = false) {
+        const uint8_t* p = (const uint8_t*)data;
+        size_t total = len;
+
+        while (len) {
+            if (!_len && len >= _size && !pgm) {
+                _send(p, len);
+                break;
+            }
+            size_t n = _size - _len;
+            if (n > len) n = len;
+#ifdef ARDUINO
+            if (pgm) memcpy_P(_buf + _len, p, n);
+            else
+#endif
+                memcpy(_buf + _len, p, n);
+            _len += n;
+            p += n;
+            len -= n;
+            if (_len == _size) flush();
+        }
+        return total;
+    }
+
+    // отправить данные из буфера. Вызвать в конце сборки
+    bool flush() {
+        if (_len) _send(_buf, _len);
+        _len = 0;
+        return !_err;
+    }
+
+    // начать новый пакет: сбросить буфер и счётчики
+    void clear() {
+        _len = _sent = _flushes = 0;
+        _err = false;
+    }
+
+    // размер пакета в байтах (отправлено + в буфере)
+    size_t length() const {
+        return _sent + _len;
+    }
+
+    // отправлено байт
+    size_t sent() const {
+        return _sent;
+    }
+
+    // количество отправок
+    size_t flushes() const {
+        return _flushes;
+    }
+
+    // была ошибка отправки
+    bool error() const {
+        return _err;
+    }
+
+   private:
+    uint8_t* _buf;
+    size_t _size;
+    size_t _len = 0;
+    size_t _sent = 0;
+    size_t _flushes = 0;
+    Callback _cb = nullptr;
+#ifdef ARDUINO
+    Print* _print = nullptr;
+#endif
+#ifdef BS_WRITER_FD
+    int _fd = -1;
+#endif
+    bool _err = false;
+
+    void _send(const uint8_t* data, size_t len) {
+        _sent += len;
+        _flushes++;
+
+        if (_cb) {
+            _cb(data, len);
+            return;
+        }
+#ifdef ARDUINO
+        if (_print) {
+            if (_print->write(data, len) != len) _err = true;
+            return;
+        }
+#endif
+#ifdef BS_WRITER_FD
+        while (len && _fd >= 0) {
+            ssize_t w = ::write(_fd, data, len);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                _err = true;
+                return;
+            }
+            data += w;
+            len -= w;
+        }
+#endif
+    }
+};